@@ -0,0 +1,139 @@
+#!/usr/bin/perl
+
+# bench.pl -- run the run6502 macro-benchmarks and report emulation speed
+#
+# usage: perl bench.pl [-r reps] [-t seconds] run6502 [workload ...]
+#
+# Each workload is either a hex listing (NAME.hex, assembled here into
+# NAME.bin) or a cc65 C program (NAME.c, compiled with cl65 when the
+# cc65 runtime in ../cc65 has been built).  The header of each file
+# gives the run6502 command line ('run:') and the expected output
+# ('expect:', either the literal first line or 'md5 HEXDIGEST').
+#
+# The number of instructions a workload executes is measured once, by
+# counting the lines of an instruction trace ('-t'); after that each
+# workload is timed 'reps' times with stdin redirected from /dev/null.
+# A workload takes only a fraction of a second (run6502 aborts after
+# 100 million instructions), so each timing runs it back to back until
+# at least 'seconds' (default 2) have passed and divides by the number
+# of runs; a single run would be mostly timer and scheduling noise.
+# The best time is used to compute MIPS and ns per instruction.
+
+use strict;
+use Cwd qw(abs_path);
+use File::Basename qw(dirname);
+use Digest::MD5 qw(md5_hex);
+use Time::HiRes qw(time);
+
+my ($reps, $seconds)= (5, 2);
+while (@ARGV && $ARGV[0] =~ /^-/) {
+  my $opt= shift;
+  if    ($opt eq '-r') { $reps= shift; }
+  elsif ($opt eq '-t') { $seconds= shift; }
+  else { die "usage: $0 [-r reps] [-t seconds] run6502 [workload ...]\n"; }
+}
+my $run6502= abs_path(shift || die "usage: $0 [-r reps] [-t seconds] run6502 [workload ...]\n");
+die "$run6502: not executable\n" unless -x $run6502;
+
+chdir dirname(abs_path($0)) or die "chdir: $!\n";
+
+my @workloads= @ARGV ? @ARGV : (sort(glob("*.hex")), sort(glob("*.c")));
+
+sub header {
+  my ($file)= @_;
+  my %h;
+  open(my $in, '<', $file) or die "$file: $!\n";
+  while (<$in>) {
+    $h{$1}= $2 if /^\s*[;*]\s*(run|expect|build):\s*(.*?)\s*$/;
+  }
+  close $in;
+  die "$file: no 'run:' line\n" unless $h{run};
+  return \%h;
+}
+
+sub assemble {
+  my ($hex, $bin)= @_;
+  open(my $in, '<', $hex) or die "$hex: $!\n";
+  open(my $out, '>', $bin) or die "$bin: $!\n";
+  binmode $out;
+  while (<$in>) {
+    s/;.*//;
+    s/\s+//g;
+    print $out pack("H*", $_);
+  }
+  close $out;
+  close $in;
+}
+
+sub runOnce {
+  my ($args, $trace)= @_;
+  my $cmd= "$run6502 $args" . ($trace ? " -t" : "") . " </dev/null";
+  my $start= time;
+  open(my $pipe, '-|', $cmd) or die "$cmd: $!\n";
+  binmode $pipe;
+  local $/;
+  my $output= <$pipe>;
+  close $pipe;
+  return ($output, time - $start);
+}
+
+# time of one run, averaged over as many as fit in $seconds
+
+sub runTimed {
+  my ($args, $expect)= @_;
+  my ($runs, $elapsed, $ok)= (0, 0, 1);
+  while (!$runs || $elapsed < $seconds) {
+    my ($output, $t)= runOnce($args, 0);
+    $ok &&= check($output, $expect);
+    $elapsed += $t;
+    ++$runs;
+  }
+  return ($elapsed / $runs, $ok);
+}
+
+sub check {
+  my ($output, $expect)= @_;
+  return 1 unless defined $expect;
+  return md5_hex($output) eq $1 if $expect =~ /^md5\s+([0-9a-f]{32})$/;
+  my ($first)= split(/\n/, $output);
+  return $first eq $expect;
+}
+
+printf "%-10s %12s %10s %10s %8s %10s\n", "workload", "insns", "best(s)", "mean(s)", "MIPS", "ns/insn";
+
+my ($totalInsns, $totalTime)= (0, 0);
+
+foreach my $file (@workloads) {
+  my ($name)= ($file =~ /^(.*)\.(hex|c)$/) or die "$file: unknown workload type\n";
+  my $h= header($file);
+  if ($file =~ /\.hex$/) {
+    assemble($file, "$name.bin");
+  } elsif (!-f "$name.bin") {
+    if (system("cl65 --version >/dev/null 2>&1") || !-f "../cc65/run6502.lib") {
+      printf "%-10s skipped (needs cl65 and ../cc65/run6502.lib)\n", $name;
+      next;
+    }
+    system($h->{build}) == 0 or die "$name: build failed\n";
+  }
+
+  my ($trace)= runOnce($h->{run}, 1);
+  my $insns= () = ($trace =~ /^;PC=/mg);
+  undef $trace;
+
+  my ($best, $sum, $ok)= (0, 0, 1);
+  for (my $i= 0;  $i < $reps;  ++$i) {
+    my ($t, $same)= runTimed($h->{run}, $h->{expect});
+    $ok &&= $same;
+    $best= $t if !$i || $t < $best;
+    $sum += $t;
+  }
+  printf "%-10s %12d %10.3f %10.3f %8.2f %10.2f%s\n",
+    $name, $insns, $best, $sum / $reps, $insns / $best / 1e6, $best * 1e9 / $insns,
+    $ok ? "" : "  WRONG OUTPUT";
+  $totalInsns += $insns;
+  $totalTime  += $best;
+}
+
+printf "%-10s %12d %10.3f %10s %8.2f %10.2f\n",
+  "total", $totalInsns, $totalTime, "", $totalInsns / $totalTime / 1e6, $totalTime * 1e9 / $totalInsns
+  if $totalTime;
@@ -0,0 +1,87 @@
+/* cc65bench.c -- cc65-compiled run6502 benchmark
+ *
+ * Exercises the code cc65 typically generates: soft-stack argument
+ * passing, 16-bit multiply/divide/modulo and shift helpers from the
+ * runtime library, array indexing through pointers, and printf.
+ *
+ * build:  cl65 -Osir -t none -C ../cc65/run6502.cfg cc65bench.c ../cc65/run6502.lib -o cc65bench.bin
+ * run:    -l 07ff cc65bench.bin -P FF00 -G FF01 -E FF02 -X 0 -R 080d
+ * expect: primes 550 sum 1013507 sort 42936 crc 25128
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define LIMIT	4000
+#define COUNT	400
+
+static uint16_t data[COUNT];
+static uint16_t seed= 1;
+
+
+static uint16_t random16(void)
+{
+  seed= seed * 109 + 89;
+  return seed;
+}
+
+
+static int isPrime(uint16_t n)
+{
+  uint16_t d;
+  if (n < 2) return 0;
+  for (d= 2;  d * d <= n;  ++d)
+    if (0 == n % d)
+      return 0;
+  return 1;
+}
+
+
+static void sort(uint16_t *v, uint16_t n)
+{
+  uint16_t i, j, t;
+  for (i= 1;  i < n;  ++i)
+    {
+      t= v[i];
+      for (j= i;  j > 0 && v[j - 1] > t;  --j)
+	v[j]= v[j - 1];
+      v[j]= t;
+    }
+}
+
+
+static uint16_t crc16(const uint16_t *v, uint16_t n)
+{
+  uint16_t crc= 0xFFFF;
+  uint8_t  b;
+  while (n--)
+    {
+      crc ^= *v++;
+      for (b= 0;  b < 16;  ++b)
+	crc= (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+    }
+  return crc;
+}
+
+
+int main(void)
+{
+  uint16_t i, primes= 0, sorted= 0;
+  uint32_t sum= 0;
+
+  for (i= 0;  i < LIMIT;  ++i)
+    if (isPrime(i))
+      {
+	++primes;
+	sum += i;
+      }
+
+  for (i= 0;  i < COUNT;  ++i)
+    data[i]= random16() / 3;
+  sort(data, COUNT);
+  for (i= 1;  i < COUNT;  ++i)
+    sorted += (data[i - 1] <= data[i]) * (i & 0xFF);
+
+  printf("primes %u sum %lu sort %u crc %u\n", primes, (unsigned long)sum, sorted, crc16(data, COUNT));
+  return 0;
+}
@@ -0,0 +1,190 @@
+#!/usr/bin/perl
+
+# fuse.pl -- choose superinstructions from workload profiles
+#
+# usage: perl fuse.pl [-n count] run6502 [workload ...]  > lib6502_fused.h
+#        perl fuse.pl -c reference candidate [workload ...]
+#
+# The first form runs each workload (see bench.pl) under 'run6502 -O'
+# to count the pairs and triples of opcodes it executes, and writes a
+# lib6502_fused.h that fuses the 'count' (default 24) most frequent
+# sequences into single dispatches.  Each workload's counts are taken
+# as a fraction of its instructions, so every workload has the same
+# say however long it runs.  A sequence can start only with an
+# instruction that always falls through to the next; the last
+# instruction of a sequence can be anything (a branch, a JSR, ...).
+#
+# The second form is the correctness check: it runs every workload with
+# both binaries (typically one built with -DM6502_FUSED=0 and one
+# without) and fails unless their output is identical.  The candidate
+# runs under 'run6502 -L run', which compares every dispatch of its
+# engine (superinstructions and idle fast-forward included) against
+# its own one-instruction-at-a-time interpreter, and exits non-zero at
+# the first difference in registers, cycles, stack or memory accesses.
+
+use strict;
+use Cwd qw(abs_path);
+use File::Basename qw(dirname);
+
+my ($count, $check)= (24, 0);
+while (@ARGV && $ARGV[0] =~ /^-/) {
+  my $opt= shift;
+  if    ($opt eq '-n') { $count= shift; }
+  elsif ($opt eq '-c') { $check= 1; }
+  else { die "usage: $0 [-n count] run6502 [workload ...]\n       $0 -c reference candidate [workload ...]\n"; }
+}
+my @run6502= map { abs_path($_) } splice(@ARGV, 0, $check ? 2 : 1);
+@run6502 == ($check ? 2 : 1) or die "$0: missing run6502\n";
+-x $_ or die "$_: not executable\n" foreach @run6502;
+
+chdir dirname(abs_path($0)) or die "chdir: $!\n";
+
+my @workloads= @ARGV ? @ARGV : sort(glob("*.hex"));
+
+sub header {
+  my ($file)= @_;
+  my %h;
+  open(my $in, '<', $file) or die "$file: $!\n";
+  while (<$in>) {
+    $h{$1}= $2 if /^\s*[;*]\s*(run|expect|build):\s*(.*?)\s*$/;
+  }
+  close $in;
+  die "$file: no 'run:' line\n" unless $h{run};
+  return \%h;
+}
+
+sub assemble {
+  my ($hex, $bin)= @_;
+  open(my $in, '<', $hex) or die "$hex: $!\n";
+  open(my $out, '>', $bin) or die "$bin: $!\n";
+  binmode $out;
+  while (<$in>) {
+    s/;.*//;
+    s/\s+//g;
+    print $out pack("H*", $_);
+  }
+  close $out;
+  close $in;
+}
+
+sub prepare {
+  my ($file)= @_;
+  my ($name)= ($file =~ /^(.*)\.(hex|c)$/) or die "$file: unknown workload type\n";
+  my $h= header($file);
+  if ($file =~ /\.hex$/) {
+    assemble($file, "$name.bin");
+  } elsif (!-f "$name.bin") {
+    return;
+  }
+  return ($name, $h);
+}
+
+sub output {
+  my ($cmd)= @_;
+  open(my $pipe, '-|', "$cmd </dev/null") or die "$cmd: $!\n";
+  binmode $pipe;
+  local $/;
+  my $output= <$pipe>;
+  close $pipe;
+  return ($output, $?);
+}
+
+if ($check) {
+  my $failed= 0;
+  foreach my $file (@workloads) {
+    my ($name, $h)= prepare($file) or next;
+    my ($ref, $refStatus)= output("$run6502[0] $h->{run}");
+    my ($cand, $candStatus)= output("$run6502[1] -L run $h->{run}");
+    my $result= ($ref ne $cand) ? "DIFFERENT" : ($candStatus != $refStatus) ? "DIVERGED" : "same";
+    printf "%-10s %s\n", $name, $result;
+    $failed ||= ($result ne "same");
+  }
+  exit $failed;
+}
+
+# opcode => [name, mode, cycles, cmos] from the instruction table
+
+my %insn;
+open(my $lib, '<', "../lib6502_insns.h") or die "../lib6502_insns.h: $!\n";
+while (<$lib>) {
+  while (/([_C])\((\w\w),\s*(\w+),\s*(\w+),\s*(\d+)\)/g) {
+    $insn{lc $2}= [$3, $4, $5, $1 eq 'C' ? 1 : 0];
+  }
+}
+close $lib;
+die "../lib6502_insns.h: no instruction table\n" unless 256 == keys %insn;
+
+my %control= map { $_ => 1 } qw(brk jmp jsr rts rti bcc bcs beq bne bmi bpl bvc bvs bra ill);
+
+sub falls { my $i= $insn{$_[0]};  return !$control{$i->[0]}; }
+sub legal { my $i= $insn{$_[0]};  return $i->[0] ne 'ill'; }
+
+my (%score, @names);
+foreach my $file (@workloads) {
+  my ($name, $h)= prepare($file) or next;
+  my $profile= "$name.prof";
+  system("$run6502[0] $h->{run} -O $profile </dev/null >/dev/null") == 0 or die "$name: run6502 failed\n";
+  open(my $in, '<', $profile) or die "$profile: $!\n";
+  my $insns= 0;
+  while (<$in>) {
+    if (/^#.*:\s*(\d+) instructions/) { $insns= $1;  next; }
+    my ($n, @ops)= split;
+    $score{"@ops"} += $n / $insns if $insns;
+  }
+  close $in;
+  unlink $profile;
+  push @names, $name;
+}
+
+# choose: a triple either extends a pair already chosen or is added
+# whole; each pair has at most one third instruction
+
+my (%third, @order);
+foreach my $seq (sort { $score{$b} <=> $score{$a} || $a cmp $b } keys %score) {
+  my @ops= split(/ /, $seq);
+  next unless falls($ops[0]) && legal($ops[-1]) && (@ops == 2 || falls($ops[1]));
+  my $pair= "$ops[0] $ops[1]";
+  if (exists $third{$pair}) {
+    $third{$pair}= $ops[2] if @ops == 3 && !defined $third{$pair};
+    next;
+  }
+  last if @order == $count;
+  push @order, $pair;
+  $third{$pair}= $ops[2];
+}
+
+sub entry {
+  my ($op)= @_;
+  my $i= $insn{$op};
+  return sprintf("%s, %s, %s, %d, %d", $op, @$i);
+}
+
+my %fused;
+foreach my $pair (@order) {
+  my ($first, $second)= split(/ /, $pair);
+  my $third= $third{$pair};
+  $fused{$first} .= defined $third
+    ? "  F3(" . entry($second) . ",  " . entry($third) . ")"
+    : "  F(" . entry($second) . ")";
+}
+
+print <<EOF;
+/* lib6502_fused.h -- superinstructions			-*- C -*- */
+
+/* Generated by bench/fuse.pl from the profiles of: @names
+ * Do not edit; run 'make fused' to regenerate.
+ *
+ * fused_XX(F, F3) lists the instructions that are executed in the same
+ * dispatch as opcode XX when they follow it, as
+ *
+ *	F(op, name, mode, cycles, cmos)
+ *
+ * for a pair and F3 with the same five for each of the second and third
+ * instructions of a triple.  cmos is 1 for 65C02-only instructions.
+ */
+
+EOF
+for (my $op= 0;  $op < 256;  ++$op) {
+  my $hex= sprintf("%02x", $op);
+  print "#define fused_$hex(F, F3)" . ($fused{$hex} // '') . "\n";
+}
@@ -8,30 +8,15 @@
 #define WRCH	0xFFEE	/* Write accumulator to stdout. */
 
 /* Write the accumulator to stdout.  This function will be invoked
- * when the emulated program calls 0xFFEE.
+ * when the emulated program calls 0xFFEE.  It is a trap: it is given
+ * the registers, and when it returns 0 the emulator pops the saved PC
+ * off the stack and continues after the JSR, just as if the 'subroutine'
+ * had ended with RTS.
  */
-int wrch(M6502 *mpu, uint16_t address, uint8_t data)
+int wrch(M6502 *mpu, uint16_t address, M6502_Registers *registers)
 {
-  int pc;
-
-  /* Write the character.
-   */
-  putchar(mpu->registers->a);
-
-  /* We arrived here from a JSR instruction.  The stack contains the
-   * saved PC.  Pop it off the stack.
-   */
-  pc  = mpu->memory[++mpu->registers->s + 0x100];
-  pc |= mpu->memory[++mpu->registers->s + 0x100] << 8;
-
-  /* The JSR instruction pushes the value of PC before it has been
-   * incremented to point to the instruction after the JSR.  Return PC
-   * + 1 as the address for the next insn.  Returning non-zero
-   * indicates that we handled the 'subroutine' ourselves, and the
-   * emulator should pretend the original 'JSR' neveer happened at
-   * all.
-   */
-  return pc + 1;  /* JSR pushes next insn addr - 1 */
+  putchar(registers->a);
+  return 0;
 }
 
 
@@ -57,10 +42,10 @@ int main()
   M6502    *mpu = M6502_new(0, 0, 0);	/* Make a 6502 */
   unsigned  pc  = 0x1000;		/* PC for 'assembly' */
 
-  /* Install the two callback functions defined above.
+  /* Install the trap and the callback function defined above.
    */
-  M6502_setCallback(mpu, call, WRCH, wrch);	/* Calling FFEE -> wrch() */
-  M6502_setCallback(mpu, call,    0, done);	/* Calling 0 -> done() */
+  M6502_setTrap(mpu, WRCH, wrch);		/* Calling FFEE -> wrch() */
+  M6502_setCallback(mpu, call, 0, done);	/* Calling 0 -> done() */
 
   /* A few macros that dump bytes into the 6502's memory.
    */
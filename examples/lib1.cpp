@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lib6502.hpp"
+
+/* The program from lib1.c, run by the C++ front end.  Instead of
+ * callbacks installed in tables at run time the 'operating system' is
+ * a bus class whose member functions are compiled into the processor.
+ */
+
+#define WRCH	0xFFEE	/* Write accumulator to stdout. */
+
+struct Beeb : lib6502::RAM
+{
+  /* Called before every JSR, JMP and BRK with the address it is about
+   * to go to.  Answering 0 lets the instruction proceed normally.
+   */
+  uint16_t call(M6502_Registers &registers, uint16_t address)
+  {
+    int pc;
+
+    switch (address)
+      {
+      case WRCH:	/* Write the character and return from the JSR. */
+	putchar(registers.a);
+	pc  = memory[++registers.s + 0x100];
+	pc |= memory[++registers.s + 0x100] << 8;
+	return pc + 1;
+
+      case 0:		/* BRK through an empty vector: exit gracefully. */
+	printf("\nBRK instruction\nPC=%04X SP=%04X A=%02X X=%02X Y=%02X P=%02X\n",
+	       registers.pc, 0x0100 + registers.s, registers.a, registers.x, registers.y, registers.p);
+	exit(0);
+      }
+    return 0;
+  }
+};
+
+int main()
+{
+  static Beeb	bus;		/* 64K of memory, so not on the stack */
+  lib6502::Processor<Beeb> cpu(bus);	/* Make a 65C02 attached to it */
+  unsigned	pc= 0x1000;	/* PC for 'assembly' */
+
+# define gen1(X)	(bus.memory[pc++]= (uint8_t)(X))
+# define gen2(X,Y)	gen1(X); gen1(Y)
+# define gen3(X,Y,Z)	gen1(X); gen2(Y,Z)
+
+  gen2(0xA2, 'A'     );	// LDX #'A'
+  gen1(0x8A          );	// TXA
+  gen3(0x20,0xEE,0xFF);	// JSR FFEE
+  gen1(0xE8          );	// INX
+  gen2(0xE0, 'Z'+1   );	// CPX #'Z'+1
+  gen2(0xD0, -9      );	// BNE 0x1002
+  gen2(0xA9, '\n'    );	// LDA #'\n'
+  gen3(0x20,0xEE,0xFF);	// JSR FFEE
+  gen2(0x00,0x00     ); // BRK
+
+  /* Point the RESET vector at the program, reset the processor and run
+   * it for (at most) a million cycles.
+   */
+  bus.memory[M6502_RSTVectorLSB]= 0x00;
+  bus.memory[M6502_RSTVectorMSB]= 0x10;
+  cpu.reset();
+  cpu.run(1000000);
+
+  return 0;
+}
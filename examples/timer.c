@@ -0,0 +1,83 @@
+/* A run6502 device plugin: a programmable interval timer.
+ *
+ * Build it as a shared object and load it with -D:
+ *
+ *	cc -shared -fPIC -I.. -o timer.so timer.c
+ *	run6502 -D ./timer.so:FE60 ...
+ *
+ * The timer occupies three bytes starting at the address given after
+ * the ':' (FE60 by default):
+ *
+ *	base+0	write: low byte of the period (in clock cycles)
+ *	base+1	write: high byte of the period; (re)starts the timer
+ *	base+2	read:  bit 7 set if the timer has expired since the last
+ *		       read (reading clears it)
+ *		write: bit 0 enables an interrupt request on expiry
+ *
+ * Once started the timer expires every 'period' cycles until a period
+ * of zero is written.  Nothing is polled: each expiry is an event in
+ * the emulator's scheduler.
+ */
+
+#include <stdlib.h>
+
+#include "run6502_plugin.h"
+
+static Run6502_Host *host;
+static uint16_t	     base= 0xfe60;
+static uint16_t	     period;
+static uint8_t	     status, control;
+
+
+static void expire(M6502 *mpu, uint64_t when, void *data)
+{
+  status |= 0x80;
+  if (control & 1)
+    host->scheduleIRQ(mpu, when);
+  host->schedule(mpu, when + period, expire, 0);	/* no drift */
+}
+
+
+static int timerRead(M6502 *mpu, uint16_t addr, uint8_t data)
+{
+  uint8_t value= 0;
+  if (addr == base + 2)
+    {
+      value= status;
+      status= 0;
+    }
+  return value;
+}
+
+
+static int timerWrite(M6502 *mpu, uint16_t addr, uint8_t data)
+{
+  switch (addr - base)
+    {
+    case 0:
+      period= (period & 0xff00) | data;
+      break;
+    case 1:
+      period= (period & 0x00ff) | (data << 8);
+      host->cancel(mpu, expire, 0);
+      if (period)
+	host->schedule(mpu, mpu->cycles + period, expire, 0);
+      break;
+    case 2:
+      control= data;
+      break;
+    }
+  return data;
+}
+
+
+int run6502_plugin_init(Run6502_Host *h, const char *args)
+{
+  host= h;
+  if (host->version != RUN6502_PLUGIN_VERSION)
+    return 0;
+  if (*args)
+    base= strtol(args, 0, 16);
+  host->map(host, base, base + 2, timerRead, timerWrite);
+  return 1;
+}
@@ -3,13 +3,27 @@
 
 
 #include <stdio.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct _M6502		M6502;
 typedef struct _M6502_Registers	M6502_Registers;
 typedef struct _M6502_Callbacks	M6502_Callbacks;
+typedef struct _M6502_Analysis	M6502_Analysis;
+typedef struct _M6502_Block	M6502_Block;
+typedef struct _M6502_Counters	M6502_Counters;
+typedef struct _M6502_Heatmap	M6502_Heatmap;
+typedef struct _M6502_ROM	M6502_ROM;
 
 typedef int   (*M6502_Callback)(M6502 *mpu, uint16_t address, uint8_t data);
+typedef int   (*M6502_Trap)(M6502 *mpu, uint16_t address, M6502_Registers *registers);
+typedef void  (*M6502_Event)(M6502 *mpu, uint64_t when, void *data);
+typedef int   (*M6502_Idle)(M6502 *mpu, uint64_t until, int io);
+typedef const char *(*M6502_Symbols)(void *data, uint16_t address);
 
 typedef M6502_Callback	M6502_CallbackTable[0x10000];
 typedef uint8_t		M6502_Memory[0x10000];
@@ -43,6 +57,70 @@ struct _M6502
   uint8_t	  *memory;
   M6502_Callbacks *callbacks;
   unsigned int	   flags;
+  int		   model;
+  uint64_t	   cycles;	/* clock cycles executed */
+  uint64_t	   deadline;	/* cycle of the next scheduled event (atomic) */
+  struct _M6502_Events *events;
+  struct _M6502_Debug  *debug;	/* breakpoints and watchpoints */
+  struct _M6502_Idle   *idle;	/* idle loop detection */
+  struct _M6502_Checkpoints *checkpoints;
+  struct _M6502_Traps  *traps;	/* native subroutines */
+  struct _M6502_Counting *counting;	/* performance counters, if on */
+  uint8_t	  *coverage;	/* one bit per executed instruction, if on */
+  M6502_Heatmap	  *heatmap;	/* accesses per address, if on */
+};
+
+struct _M6502_Counters
+{
+  uint64_t instructions;	/* retired */
+  uint64_t cycles;
+  uint64_t reads;		/* read callbacks invoked */
+  uint64_t writes;		/* write callbacks invoked */
+  uint64_t calls;		/* call callbacks (and traps) invoked */
+  uint64_t irqs;		/* interrupt requests taken */
+  uint64_t nmis;		/* non-maskable interrupts taken */
+  uint64_t callbackTime;	/* nanoseconds spent in callbacks */
+  uint64_t opcodes[256];	/* instructions retired, by opcode */
+};
+
+struct _M6502_Heatmap
+{
+  uint64_t reads[0x10000];	/* operands, data and stack pulls */
+  uint64_t writes[0x10000];	/* data and stack pushes */
+  uint64_t executes[0x10000];	/* instructions started */
+};
+
+struct _M6502_ROM
+{
+  const uint8_t *data;		/* the contents (read only) */
+  size_t	 length;	/* in bytes */
+  int		 fd;		/* the rest is private */
+  int		 refs;
+  uint64_t	 hash;
+  M6502_ROM	*next;
+};
+
+struct _M6502_Block
+{
+  uint16_t first;	/* address of the first instruction */
+  uint16_t last;	/* address of the last instruction */
+  unsigned size;	/* in bytes */
+  uint16_t next;	/* the instruction after the block (if M6502_Falls) */
+  uint16_t target;	/* where it branches, jumps or calls (if M6502_Jumps) */
+  unsigned flags;	/* M6502_Falls... */
+};
+
+struct _M6502_Analysis
+{
+  uint8_t	 map[0x10000];	/* M6502_Code... for each byte of memory */
+  int		 count;		/* of blocks */
+  M6502_Block	*blocks;	/* in order of address */
+};
+
+// processor models (see M6502_newModel)
+enum {
+  M6502_NMOS = 0,	/* original 6502 */
+  M6502_CMOS = 1	/* 65C02 */
 };
 
 // used for the flags abvoe
@@ -50,18 +128,90 @@ enum {
   M6502_RegistersAllocated = 1 << 0,
   M6502_MemoryAllocated    = 1 << 1,
   M6502_CallbacksAllocated = 1 << 2,
-  M6502_TraceExecution     = 1 << 3
+  M6502_TraceExecution     = 1 << 3,
+  M6502_SingleStep         = 1 << 4
+};
+
+// how M6502_lockstep runs the candidate
+enum {
+  M6502_LockstepStep = 0,	/* one instruction at a time, like the reference */
+  M6502_LockstepRun  = 1	/* with its own engine (superinstructions, idle fast-forward) */
+};
+
+// kinds of access for breakpoints and watchpoints
+enum {
+  M6502_Break      = 1 << 0,
+  M6502_WatchRead  = 1 << 1,
+  M6502_WatchWrite = 1 << 2
+};
+
+// what M6502_analyse found at each byte of memory (M6502_Analysis.map)
+enum {
+  M6502_Code    = 1 << 0,	/* the first byte of an instruction */
+  M6502_Operand = 1 << 1,	/* a later byte of an instruction */
+  M6502_Leader  = 1 << 2,	/* the first instruction of a block */
+  M6502_Entry   = 1 << 3,	/* an entry point (a vector, or given) */
+  M6502_Written = 1 << 4	/* possibly written by the code found */
+};
+
+// how a block ends (M6502_Block.flags)
+enum {
+  M6502_Falls    = 1 << 0,	/* may continue at next */
+  M6502_Jumps    = 1 << 1,	/* may branch, jump or call to target */
+  M6502_Calls    = 1 << 2,	/* with JSR, expecting to return to next */
+  M6502_Returns  = 1 << 3,	/* with RTS or RTI */
+  M6502_Indirect = 1 << 4,	/* with an indirect JMP, to somewhere unknown */
+  M6502_Stops    = 1 << 5,	/* with BRK or an undefined instruction */
+  M6502_Modified = 1 << 6	/* some of the block is M6502_Written */
 };
 
 extern M6502 *M6502_new(M6502_Registers *registers, M6502_Memory memory, M6502_Callbacks *callbacks);
+extern M6502 *M6502_newModel(int model, M6502_Registers *registers, M6502_Memory memory, M6502_Callbacks *callbacks);
 extern void   M6502_reset(M6502 *mpu);
 extern void   M6502_nmi(M6502 *mpu);
 extern void   M6502_irq(M6502 *mpu);
 extern void   M6502_run(M6502 *mpu);
+extern int    M6502_step(M6502 *mpu);
+extern void   M6502_stop(M6502 *mpu);
+extern void   M6502_schedule(M6502 *mpu, uint64_t when, M6502_Event event, void *data);
+extern int    M6502_cancel(M6502 *mpu, M6502_Event event, void *data);
+extern void   M6502_scheduleIRQ(M6502 *mpu, uint64_t when);
+extern void   M6502_scheduleNMI(M6502 *mpu, uint64_t when);
+extern void   M6502_setIdle(M6502 *mpu, M6502_Idle handler);
+extern void   M6502_setSignal(M6502 *mpu, M6502_Event handler, void *data);
+extern void   M6502_signal(M6502 *mpu);
+extern void   M6502_setIRQ(M6502 *mpu, int level);
+extern void   M6502_setNMI(M6502 *mpu, int level);
+extern void   M6502_setTrap(M6502 *mpu, uint16_t address, M6502_Trap trap);
+extern M6502_Trap M6502_getTrap(M6502 *mpu, uint16_t address);
+extern int    M6502_setBreakpoint(M6502 *mpu, uint16_t addr, const char *condition);
+extern int    M6502_setWatchpoint(M6502 *mpu, uint16_t first, uint16_t last, int access, const char *condition);
+extern int    M6502_clearBreakpoint(M6502 *mpu, int id);
+extern int    M6502_stopped(M6502 *mpu, char buffer[64]);
+extern void   M6502_setCheckpoints(M6502 *mpu, uint64_t interval, size_t budget);
+extern unsigned long M6502_checkpoint(M6502 *mpu);
+extern unsigned long M6502_findCheckpoint(M6502 *mpu, uint64_t cycles);
+extern int    M6502_rewind(M6502 *mpu, unsigned long id);
+extern void   M6502_touch(M6502 *mpu, uint16_t first, uint16_t last);
+extern void   M6502_setCounting(M6502 *mpu, int enable);
+extern int    M6502_getCounters(M6502 *mpu, M6502_Counters *counters);
+extern void   M6502_resetCounters(M6502 *mpu);
+extern void   M6502_setCoverage(M6502 *mpu, uint8_t *bitmap);
+extern void   M6502_setHeatmap(M6502 *mpu, M6502_Heatmap *heatmap);
+extern M6502_ROM *M6502_newROM(const uint8_t *data, size_t length, const char *pool);
+extern void   M6502_mapROM(M6502 *mpu, uint16_t address, M6502_ROM *rom);
+extern void   M6502_deleteROM(M6502_ROM *rom);
 extern int    M6502_disassemble(M6502 *mpu, uint16_t addr, char buffer[64]);
+extern unsigned M6502_disassembleRange(M6502 *mpu, uint16_t addr, unsigned length, char *buffer, size_t size, M6502_Symbols symbols, void *data);
 extern void   M6502_dump(M6502 *mpu, char buffer[64]);
 extern void   M6502_delete(M6502 *mpu);
 
+extern M6502_Analysis *M6502_analyse(M6502 *mpu, const uint16_t *entries, int count);
+extern M6502_Block    *M6502_findBlock(M6502_Analysis *analysis, uint16_t address);
+extern void	       M6502_deleteAnalysis(M6502_Analysis *analysis);
+
+extern unsigned long M6502_lockstep(M6502 *reference, M6502 *candidate, int engine, unsigned long limit, FILE *report);
+
 #define M6502_getVector(MPU, VEC)			\
   ( ( ((MPU)->memory[M6502_##VEC##VectorLSB]) )		\
     | ((MPU)->memory[M6502_##VEC##VectorMSB] << 8) )
@@ -73,5 +223,8 @@ extern void   M6502_delete(M6502 *mpu);
 #define M6502_getCallback(MPU, TYPE, ADDR)	((MPU)->callbacks->TYPE[ADDR])
 #define M6502_setCallback(MPU, TYPE, ADDR, FN)	((MPU)->callbacks->TYPE[ADDR]= (FN))
 
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* __m6502_h */
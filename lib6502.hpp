@@ -0,0 +1,458 @@
+/* lib6502.hpp -- C++ front end with a compile-time memory bus	-*- C++ -*- */
+
+/* lib6502::Processor<Bus> is a processor whose data accesses go to the
+ * member functions of Bus instead of through the callback tables of
+ * the C library.  The instructions are the library's own (from
+ * lib6502_insns.h) expanded inside the template, so when Bus::read and
+ * Bus::write are visible and simple (plain memory, or a test of the
+ * address and a device register) they are inlined into each
+ * instruction and cost no more than a direct memory access.
+ *
+ * Bus must provide
+ *
+ *	uint8_t  memory[0x10000];
+ *	uint8_t  read(uint16_t address);
+ *	void	 write(uint16_t address, uint8_t data);
+ *	uint16_t call(M6502_Registers &registers, uint16_t address);
+ *
+ * Instructions and operands are fetched from memory directly, as is
+ * the stack; read and write see every other access.  call is made
+ * before control passes to address by JSR, JMP or BRK (address is then
+ * the IRQ handler), with the registers as they are at that moment.  It
+ * answers the address to continue from, or 0 to carry on normally, just
+ * like a call callback.  lib6502::RAM is a bus with nothing but memory,
+ * from which others can be derived.
+ *
+ * There are no events, breakpoints, idle loop detection or tracing;
+ * run() executes until a given cycle count, stop() or an undefined
+ * instruction.  The C API in lib6502.h is unaffected and can be used in
+ * the same program.
+ */
+
+#ifndef __m6502_hpp
+#define __m6502_hpp
+
+#include "lib6502.h"
+
+namespace lib6502 {
+
+#include "lib6502_insns.h"
+
+struct RAM
+{
+  M6502_Memory memory;
+
+  uint8_t  read(uint16_t address)				{ return memory[address]; }
+  void	   write(uint16_t address, uint8_t data)		{ memory[address]= data; }
+  uint16_t call(M6502_Registers &, uint16_t)			{ return 0; }
+};
+
+
+template <class Bus, int Model= M6502_CMOS>
+class Processor
+{
+public:
+  M6502_Registers registers;
+  uint64_t	  cycles;	/* clock cycles executed */
+
+  Processor(Bus &bus) : cycles(0), bus(bus), deadline(0)
+  {
+    registers.a= registers.x= registers.y= registers.p= registers.s= 0;
+    registers.pc= 0;
+  }
+
+  void reset(void)
+  {
+    registers.p &= ~flagD;
+    registers.p |=  flagI;
+    registers.pc= vector(M6502_RSTVector);
+  }
+
+  void nmi(void)
+  {
+    interrupt(M6502_NMIVector);
+  }
+
+  void irq(void)
+  {
+    if (!(registers.p & flagI))
+      interrupt(M6502_IRQVector);
+  }
+
+  /* execute until the clock reaches until, stop() is called, or an
+   * undefined instruction is found (answering 0 and leaving the
+   * registers as they were before it)
+   */
+
+  int run(uint64_t until)
+  {
+    byte    *memory= bus.memory;
+    byte     A, X, Y, P, S;
+    word     PC, ea, insn;
+    uint64_t cycles, start;
+
+# define CMOS		(M6502_CMOS == Model)
+# define fetch()
+# define next()		break
+# define halt()		{ PC= insn;  cycles= start;  externalise();  return 0; }
+# define internalise()	A= registers.a;  X= registers.x;  Y= registers.y;  P= registers.p;  S= registers.s;  PC= registers.pc;  cycles= this->cycles
+# define externalise()	registers.a= A;  registers.x= X;  registers.y= Y;  registers.p= P;  registers.s= S;  registers.pc= PC;  this->cycles= cycles
+# define getMemory(ADDR)	bus.read(ADDR)
+# define putMemory(ADDR, BYTE)	bus.write(ADDR, BYTE)
+# define hasCall(ADDR)		1
+# define callMemory(ADDR, ARG)	bus.call(registers, ADDR)
+# define isTrap(ADDR)		0
+# define callTrap(ADDR)
+# define isBreakTrap(ADDR)	0
+# define breakTrap(ADDR)
+# define idleBranch()
+# define idleJump(FROM)		(void)(FROM)
+# define idleMiss()
+# define heat(ADDR, KIND)	(ADDR)
+# define unmask()
+
+    /* 'and' is an operator in C++ and cannot name a macro, so every
+     * instruction is reached through one of these */
+
+# define insn_adc	adc
+# define insn_and(ticks, adrmode)	bitwise(ticks, adrmode, &)
+# define insn_asl	asl
+# define insn_asla	asla
+# define insn_bcc	bcc
+# define insn_bcs	bcs
+# define insn_beq	beq
+# define insn_bit	bit
+# define insn_bmi	bmi
+# define insn_bne	bne
+# define insn_bpl	bpl
+# define insn_bra	bra
+# define insn_brk	brk
+# define insn_bvc	bvc
+# define insn_bvs	bvs
+# define insn_clc	clc
+# define insn_cld	cld
+# define insn_cli	cli
+# define insn_clv	clv
+# define insn_cmp	cmp
+# define insn_cpx	cpx
+# define insn_cpy	cpy
+# define insn_dea	dea
+# define insn_dec	dec
+# define insn_dex	dex
+# define insn_dey	dey
+# define insn_eor	eor
+# define insn_ill	ill
+# define insn_ina	ina
+# define insn_inc	inc
+# define insn_inx	inx
+# define insn_iny	iny
+# define insn_jmp	jmp
+# define insn_jsr	jsr
+# define insn_lda	lda
+# define insn_ldx	ldx
+# define insn_ldy	ldy
+# define insn_lsr	lsr
+# define insn_lsra	lsra
+# define insn_nop	nop
+# define insn_ora	ora
+# define insn_pha	pha
+# define insn_php	php
+# define insn_phx	phx
+# define insn_phy	phy
+# define insn_pla	pla
+# define insn_plp	plp
+# define insn_plx	plx
+# define insn_ply	ply
+# define insn_rol	rol
+# define insn_rola	rola
+# define insn_ror	ror
+# define insn_rora	rora
+# define insn_rti	rti
+# define insn_rts	rts
+# define insn_sbc	sbc
+# define insn_sec	sec
+# define insn_sed	sed
+# define insn_sei	sei
+# define insn_sta	sta
+# define insn_stx	stx
+# define insn_sty	sty
+# define insn_stz	stz
+# define insn_tax	tax
+# define insn_tay	tay
+# define insn_trb	trb
+# define insn_tsb	tsb
+# define insn_tsx	tsx
+# define insn_txa	txa
+# define insn_txs	txs
+# define insn_tya	tya
+
+# define dispatch(num, name, mode, ticks)	case 0x##num: { insn_##name(ticks, mode); }  next();
+# define extension(num, name, mode, ticks)	case 0x##num: if (CMOS) { insn_##name(ticks, mode); } else { ill(ticks, implied); }  next();
+
+    deadline= until;
+    internalise();
+    while (cycles < deadline)
+      {
+	insn= PC;
+	start= cycles;
+	switch (memory[PC++])
+	  {
+	    do_insns(dispatch, extension);
+	  }
+      }
+    externalise();
+    return 1;
+  }
+
+  /* execute one instruction, answering 0 if it was undefined */
+
+  int step(void)
+  {
+    return run(cycles + 1);
+  }
+
+  /* make run() return after the current instruction */
+
+  void stop(void)
+  {
+    deadline= 0;
+  }
+
+private:
+  Bus	   &bus;
+  uint64_t  deadline;
+
+  uint16_t vector(uint16_t address)
+  {
+    return bus.memory[address] | (bus.memory[address + 1] << 8);
+  }
+
+  void interrupt(uint16_t address)
+  {
+    bus.memory[0x0100 + registers.s--]= registers.pc >> 8;
+    bus.memory[0x0100 + registers.s--]= registers.pc & 0xff;
+    bus.memory[0x0100 + registers.s--]= registers.p;
+    registers.p &= ~flagB;
+    registers.p |=  flagI;
+    if (M6502_CMOS == Model) registers.p &= ~flagD;
+    registers.pc= vector(address);
+    cycles += 7;
+  }
+};
+
+} /* namespace lib6502 */
+
+#undef CMOS
+#undef fetch
+#undef next
+#undef halt
+#undef internalise
+#undef externalise
+#undef getMemory
+#undef putMemory
+#undef hasCall
+#undef callMemory
+#undef isTrap
+#undef callTrap
+#undef isBreakTrap
+#undef breakTrap
+#undef idleBranch
+#undef idleJump
+#undef idleMiss
+#undef heat
+#undef unmask
+#undef dispatch
+#undef extension
+#undef insn_adc
+#undef insn_and
+#undef insn_asl
+#undef insn_asla
+#undef insn_bcc
+#undef insn_bcs
+#undef insn_beq
+#undef insn_bit
+#undef insn_bmi
+#undef insn_bne
+#undef insn_bpl
+#undef insn_bra
+#undef insn_brk
+#undef insn_bvc
+#undef insn_bvs
+#undef insn_clc
+#undef insn_cld
+#undef insn_cli
+#undef insn_clv
+#undef insn_cmp
+#undef insn_cpx
+#undef insn_cpy
+#undef insn_dea
+#undef insn_dec
+#undef insn_dex
+#undef insn_dey
+#undef insn_eor
+#undef insn_ill
+#undef insn_ina
+#undef insn_inc
+#undef insn_inx
+#undef insn_iny
+#undef insn_jmp
+#undef insn_jsr
+#undef insn_lda
+#undef insn_ldx
+#undef insn_ldy
+#undef insn_lsr
+#undef insn_lsra
+#undef insn_nop
+#undef insn_ora
+#undef insn_pha
+#undef insn_php
+#undef insn_phx
+#undef insn_phy
+#undef insn_pla
+#undef insn_plp
+#undef insn_plx
+#undef insn_ply
+#undef insn_rol
+#undef insn_rola
+#undef insn_ror
+#undef insn_rora
+#undef insn_rti
+#undef insn_rts
+#undef insn_sbc
+#undef insn_sec
+#undef insn_sed
+#undef insn_sei
+#undef insn_sta
+#undef insn_stx
+#undef insn_sty
+#undef insn_stz
+#undef insn_tax
+#undef insn_tay
+#undef insn_trb
+#undef insn_tsb
+#undef insn_tsx
+#undef insn_txa
+#undef insn_txs
+#undef insn_tya
+#undef abs
+#undef absx
+#undef absy
+#undef adc
+#undef asl
+#undef asla
+#undef bcc
+#undef bcs
+#undef beq
+#undef bit
+#undef bitNV_abs
+#undef bitNV_absx
+#undef bitNV_immediate
+#undef bitNV_zp
+#undef bitNV_zpx
+#undef bitwise
+#undef bmi
+#undef bne
+#undef bpl
+#undef bra
+#undef branch
+#undef brk
+#undef bvc
+#undef bvs
+#undef clc
+#undef cld
+#undef clF
+#undef cli
+#undef clv
+#undef cmp
+#undef cmpR
+#undef cpx
+#undef cpy
+#undef dea
+#undef dec
+#undef decR
+#undef dex
+#undef dey
+#undef direct
+#undef do_insns
+#undef eor
+#undef getB
+#undef getC
+#undef getD
+#undef getI
+#undef getN
+#undef getV
+#undef getZ
+#undef ill
+#undef immediate
+#undef implied
+#undef ina
+#undef inc
+#undef incR
+#undef indabsx
+#undef indirect
+#undef indx
+#undef indy
+#undef indzp
+#undef inx
+#undef iny
+#undef jmp
+#undef jsr
+#undef lda
+#undef ldR
+#undef ldx
+#undef ldy
+#undef lsr
+#undef lsra
+#undef NAND
+#undef nop
+#undef ora
+#undef pha
+#undef php
+#undef phR
+#undef phx
+#undef phy
+#undef pla
+#undef plp
+#undef plR
+#undef plx
+#undef ply
+#undef pop
+#undef push
+#undef relative
+#undef rol
+#undef rola
+#undef ror
+#undef rora
+#undef rti
+#undef rts
+#undef sbc
+#undef sec
+#undef sed
+#undef seF
+#undef sei
+#undef setC
+#undef setNVZC
+#undef setNZ
+#undef setNZC
+#undef setZ
+#undef sta
+#undef stR
+#undef stx
+#undef sty
+#undef stz
+#undef tax
+#undef tay
+#undef tick
+#undef tickIf
+#undef trb
+#undef tRS
+#undef tsb
+#undef tsx
+#undef txa
+#undef txs
+#undef tya
+#undef zp
+#undef zpx
+#undef zpy
+
+#endif /* __m6502_hpp */
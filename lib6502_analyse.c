@@ -0,0 +1,226 @@
+/* lib6502_analyse.c -- static control-flow analysis		-*- C -*- */
+
+/* Code is found by recursive descent from the RST, NMI and IRQ vectors
+ * and any other entry points the client knows of (symbols, say).  Each
+ * is decoded instruction by instruction until something that does not
+ * continue to the next instruction (a jump, return, BRK or undefined
+ * instruction); the target of every branch, jump and JSR, and the
+ * instruction after every branch and JSR, is decoded the same way in
+ * turn.  (A JSR is assumed to return.)  Those targets, and any
+ * instruction reached both by falling through and from somewhere else,
+ * start basic blocks.  Indirect jumps end a block whose successors are
+ * unknown.
+ *
+ * Stores and read-modify-write instructions with absolute or zero-page
+ * addressing mark the bytes they may write (every byte within reach of
+ * the index register for the indexed modes); stores through a pointer
+ * are not followed.  Code that is marked was probably modified by the
+ * program itself.
+ */
+
+enum { flowNext, flowBranch, flowJump, flowCall, flowIndirect, flowReturn, flowStop };
+
+
+static int analyseFlow(int model, byte op)
+{
+  const char *name= dumpInsns[model][op].name;
+  int	      mode= dumpInsns[model][op].mode;
+
+  if (!strcmp(name, "bra"))					return flowJump;
+  if (dumpRelative == mode)					return flowBranch;
+  if (!strcmp(name, "jsr"))					return flowCall;
+  if (!strcmp(name, "jmp"))					return (dumpAbs == mode) ? flowJump : flowIndirect;
+  if (!strcmp(name, "rts") || !strcmp(name, "rti"))		return flowReturn;
+  if (!strcmp(name, "brk") || !strcmp(name, "ill"))		return flowStop;
+  return flowNext;
+}
+
+
+static int analyseWrites(int model, byte op)
+{
+  static const char *writers[]= { "sta", "stx", "sty", "stz", "inc", "dec", "asl", "lsr", "rol", "ror", "trb", "tsb", 0 };
+  const char **w;
+
+  for (w= writers;  *w;  ++w)
+    if (!strcmp(*w, dumpInsns[model][op].name))
+      return 1;
+  return 0;
+}
+
+
+static void analyseWritten(M6502_Analysis *a, M6502 *mpu, word ip)
+{
+  byte *m= mpu->memory;
+  word  ea= m[(word)(ip + 1)] | (m[(word)(ip + 2)] << 8);
+  int	i;
+
+  switch (dumpInsns[mpu->model][m[ip]].mode)
+    {
+    case dumpZp:	a->map[(byte)ea] |= M6502_Written;				break;
+    case dumpZpx:
+    case dumpZpy:	for (i= 0;  i < 0x100;  ++i) a->map[i] |= M6502_Written;	break;
+    case dumpAbs:	a->map[ea] |= M6502_Written;					break;
+    case dumpAbsx:
+    case dumpAbsy:	for (i= 0;  i < 0x100;  ++i) a->map[(word)(ea + i)] |= M6502_Written;	break;
+    }
+}
+
+
+/* make addr the start of a block and remember to decode from there */
+
+static void analyseLeader(M6502_Analysis *a, word *work, int *count, word addr)
+{
+  if (!(a->map[addr] & M6502_Leader))
+    {
+      a->map[addr] |= M6502_Leader;
+      work[(*count)++]= addr;
+    }
+}
+
+
+static void analyseTrace(M6502_Analysis *a, M6502 *mpu, word *work, int *count, word ip)
+{
+  byte *m= mpu->memory;
+
+  for (;;)
+    {
+      byte op= m[ip];
+      int  length= dumpInsns[mpu->model][op].length, i;
+      word target;
+
+      if (a->map[ip] & M6502_Code)
+	{
+	  a->map[ip] |= M6502_Leader;	/* reached from two places */
+	  return;
+	}
+      a->map[ip] |= M6502_Code;
+      for (i= 1;  i < length;  ++i)
+	a->map[(word)(ip + i)] |= M6502_Operand;
+      if (analyseWrites(mpu->model, op))
+	analyseWritten(a, mpu, ip);
+      if (dumpRelative == dumpInsns[mpu->model][op].mode)
+	target= ip + 2 + (int8_t)m[(word)(ip + 1)];
+      else
+	target= m[(word)(ip + 1)] | (m[(word)(ip + 2)] << 8);
+
+      switch (analyseFlow(mpu->model, op))
+	{
+	case flowNext:
+	  break;
+	case flowBranch:
+	case flowCall:
+	  analyseLeader(a, work, count, target);
+	  analyseLeader(a, work, count, ip + length);
+	  return;
+	case flowJump:
+	  analyseLeader(a, work, count, target);
+	  return;
+	default:
+	  return;
+	}
+      ip += length;
+    }
+}
+
+
+/* the block starting at ip, which is a leader */
+
+static void analyseBlock(M6502_Analysis *a, M6502 *mpu, word ip, M6502_Block *b)
+{
+  byte *m= mpu->memory;
+
+  b->first= ip;
+  b->next= b->target= 0;
+  b->flags= 0;
+  for (;;)
+    {
+      byte op= m[ip];
+      int  length= dumpInsns[mpu->model][op].length, i;
+      word next= ip + length;
+
+      for (i= 0;  i < length;  ++i)
+	if (a->map[(word)(ip + i)] & M6502_Written)
+	  b->flags |= M6502_Modified;
+      b->last= ip;
+      b->size= (word)(next - b->first);
+      if (dumpRelative == dumpInsns[mpu->model][op].mode)
+	b->target= next + (int8_t)m[(word)(ip + 1)];
+      else
+	b->target= m[(word)(ip + 1)] | (m[(word)(ip + 2)] << 8);
+      switch (analyseFlow(mpu->model, op))
+	{
+	case flowNext:
+	  if (!(a->map[next] & M6502_Leader))
+	    {
+	      ip= next;
+	      continue;
+	    }
+	  b->target= 0;
+	  b->flags |= M6502_Falls;
+	  b->next= next;
+	  return;
+	case flowBranch:	b->flags |= M6502_Falls | M6502_Jumps;			b->next= next;	return;
+	case flowCall:		b->flags |= M6502_Falls | M6502_Jumps | M6502_Calls;	b->next= next;	return;
+	case flowJump:		b->flags |= M6502_Jumps;					return;
+	case flowIndirect:	b->flags |= M6502_Indirect;				break;
+	case flowReturn:	b->flags |= M6502_Returns;				break;
+	case flowStop:		b->flags |= M6502_Stops;					break;
+	}
+      b->target= 0;
+      return;
+    }
+}
+
+
+M6502_Analysis *M6502_analyse(M6502 *mpu, const uint16_t *entries, int count)
+{
+  M6502_Analysis *a;
+  word		 *work;
+  int		  n= 0, i, addr;
+
+  if (!(a= calloc(1, sizeof(M6502_Analysis))) || !(work= malloc(0x10000 * sizeof(word))))
+    outOfMemory();
+  a->map[M6502_getVector(mpu, RST)] |= M6502_Entry;
+  a->map[M6502_getVector(mpu, NMI)] |= M6502_Entry;
+  a->map[M6502_getVector(mpu, IRQ)] |= M6502_Entry;
+  for (i= 0;  i < count;  ++i)
+    a->map[entries[i]] |= M6502_Entry;
+  for (addr= 0;  addr < 0x10000;  ++addr)
+    if (a->map[addr] & M6502_Entry)
+      analyseLeader(a, work, &n, addr);
+  while (n)
+    analyseTrace(a, mpu, work, &n, work[--n]);
+  free(work);
+
+  for (addr= 0;  addr < 0x10000;  ++addr)
+    if (a->map[addr] & M6502_Leader)
+      ++a->count;
+  if (!(a->blocks= malloc(a->count * sizeof(M6502_Block) + 1))) outOfMemory();
+  for (i= addr= 0;  addr < 0x10000;  ++addr)
+    if (a->map[addr] & M6502_Leader)
+      analyseBlock(a, mpu, addr, a->blocks + i++);
+  return a;
+}
+
+
+M6502_Block *M6502_findBlock(M6502_Analysis *a, uint16_t address)
+{
+  int lo= 0, hi= a->count;	/* the block is before hi */
+
+  while (lo < hi)
+    {
+      int mid= (lo + hi) / 2;
+      if (a->blocks[mid].first <= address)  lo= mid + 1;
+      else				    hi= mid;
+    }
+  if (lo && ((word)(address - a->blocks[lo - 1].first) < a->blocks[lo - 1].size))
+    return a->blocks + lo - 1;
+  return 0;
+}
+
+
+void M6502_deleteAnalysis(M6502_Analysis *a)
+{
+  free(a->blocks);
+  free(a);
+}
@@ -0,0 +1,248 @@
+/* lib6502_checkpoint.c -- incremental checkpoints and rewind	-*- C -*- */
+
+/* The engines mark each 256-byte page of memory as it is written, in
+ * a map of one byte per page; the stack page is not marked (pushes are
+ * too frequent to be worth it) and is simply saved every time.  A
+ * checkpoint holds the registers, the cycle count, a copy of the event
+ * queue and the pages marked since the checkpoint before it, and then
+ * clears the map.  The oldest checkpoint retained always holds every
+ * page, so the memory at any later checkpoint is found by applying the
+ * pages of each checkpoint from the oldest up to it in turn.  When the
+ * checkpoints take more than the budget the oldest is dropped, its
+ * pages first being given to the next one for any that it does not
+ * already hold.
+ *
+ * Writes made to memory by callbacks or by the client, rather than by
+ * the processor, are not seen by the engines; they should be reported
+ * with M6502_touch.
+ */
+
+typedef struct _Checkpoint Checkpoint;
+
+struct _Checkpoint
+{
+  unsigned long	   id;
+  M6502_Registers  registers;
+  uint64_t	   cycles;
+  Event		  *events;	/* a copy of the heap */
+  int		   nevents;
+  unsigned long	   order;
+  int		   held;	/* an interrupt request waiting for I to clear */
+  int		   npages;
+  byte		   page[256];	/* the page numbers... */
+  byte		  *data;	/* ...and their contents, 256 bytes each */
+  Checkpoint	  *next;	/* newer */
+};
+
+struct _M6502_Checkpoints
+{
+  byte		dirty[256];	/* pages written since the newest checkpoint */
+  uint64_t	interval;	/* between periodic checkpoints, or 0 */
+  size_t	budget;		/* bytes, or 0 for no limit */
+  size_t	used;
+  unsigned long	id;		/* of the newest checkpoint */
+  Checkpoint   *oldest, *newest;
+};
+
+
+static size_t checkpointSize(Checkpoint *c)
+{
+  return sizeof(Checkpoint) + c->npages * 256 + c->nevents * sizeof(Event);
+}
+
+
+static void checkpointFree(Checkpoint *c)
+{
+  free(c->events);
+  free(c->data);
+  free(c);
+}
+
+
+static void checkpointsNew(M6502 *mpu)
+{
+  if (!(mpu->checkpoints= calloc(1, sizeof(struct _M6502_Checkpoints)))) outOfMemory();
+  memset(mpu->checkpoints->dirty, 1, 256);
+}
+
+
+static void checkpointsClear(struct _M6502_Checkpoints *k)
+{
+  while (k->oldest)
+    {
+      Checkpoint *c= k->oldest;
+      k->oldest= c->next;
+      checkpointFree(c);
+    }
+  k->newest= 0;
+  k->used= 0;
+}
+
+
+static void checkpointsDelete(M6502 *mpu)
+{
+  checkpointsClear(mpu->checkpoints);
+  free(mpu->checkpoints);
+  mpu->checkpoints= 0;
+}
+
+
+/* drop the oldest checkpoint, giving the next one the pages it lacks */
+
+static void checkpointsDrop(struct _M6502_Checkpoints *k)
+{
+  Checkpoint *old= k->oldest, *c= old->next;
+  byte	     *data, have[256];
+  int	      i, missing= 0;
+
+  memset(have, 0, sizeof(have));
+  for (i= 0;  i < c->npages;  ++i)
+    have[c->page[i]]= 1;
+  for (i= 0;  i < old->npages;  ++i)
+    missing += !have[old->page[i]];
+  if (missing)
+    {
+      if (!(data= realloc(c->data, 256 * (c->npages + missing)))) outOfMemory();
+      c->data= data;
+    }
+  k->used -= checkpointSize(old) + checkpointSize(c);
+  for (i= 0;  i < old->npages;  ++i)
+    if (!have[old->page[i]])
+      {
+	c->page[c->npages]= old->page[i];
+	memcpy(c->data + 256 * c->npages++, old->data + 256 * i, 256);
+      }
+  k->used += checkpointSize(c);
+  k->oldest= c;
+  checkpointFree(old);
+}
+
+
+unsigned long M6502_checkpoint(M6502 *mpu)
+{
+  struct _M6502_Checkpoints *k= mpu->checkpoints;
+  struct _M6502_Events	    *q= mpu->events;
+  Checkpoint		    *c;
+  int			     i;
+
+  if (!(c= calloc(1, sizeof(Checkpoint)))) outOfMemory();
+  c->id=	++k->id;
+  c->registers= *mpu->registers;
+  c->cycles=	mpu->cycles;
+  c->held=	q->held;
+  if (q->size)
+    {
+      if (!(c->events= malloc(q->size * sizeof(Event)))) outOfMemory();
+      memcpy(c->events, q->heap, q->size * sizeof(Event));
+      c->nevents= q->size;
+      c->order= q->order;
+    }
+  k->dirty[1]= 1;
+  for (i= 0;  i < 256;  ++i)
+    c->npages += k->dirty[i];
+  if (!(c->data= malloc(c->npages * 256))) outOfMemory();
+  c->npages= 0;
+  for (i= 0;  i < 256;  ++i)
+    if (k->dirty[i])
+      {
+	c->page[c->npages]= i;
+	memcpy(c->data + 256 * c->npages++, mpu->memory + 256 * i, 256);
+      }
+  memset(k->dirty, 0, 256);
+
+  if (k->newest) k->newest->next= c;
+  else		 k->oldest= c;
+  k->newest= c;
+  k->used += checkpointSize(c);
+  while (k->budget && (k->used > k->budget) && (k->oldest != k->newest))
+    checkpointsDrop(k);
+  return c->id;
+}
+
+
+static void checkpointEvent(M6502 *mpu, uint64_t when, void *data)
+{
+  M6502_schedule(mpu, when + mpu->checkpoints->interval, checkpointEvent, 0);
+  M6502_checkpoint(mpu);
+}
+
+
+void M6502_setCheckpoints(M6502 *mpu, uint64_t interval, size_t budget)
+{
+  struct _M6502_Checkpoints *k= mpu->checkpoints;
+
+  M6502_cancel(mpu, checkpointEvent, 0);
+  k->interval= interval;
+  k->budget= budget;
+  if (interval)
+    M6502_schedule(mpu, mpu->cycles + interval, checkpointEvent, 0);
+  while (k->budget && (k->used > k->budget) && (k->oldest != k->newest))
+    checkpointsDrop(k);
+}
+
+
+unsigned long M6502_findCheckpoint(M6502 *mpu, uint64_t cycles)
+{
+  Checkpoint	*c;
+  unsigned long  id= 0;
+
+  for (c= mpu->checkpoints->oldest;  c && (c->cycles <= cycles);  c= c->next)
+    id= c->id;
+  return id;
+}
+
+
+int M6502_rewind(M6502 *mpu, unsigned long id)
+{
+  struct _M6502_Checkpoints *k= mpu->checkpoints;
+  struct _M6502_Events	    *q= mpu->events;
+  Checkpoint		    *c, *target;
+  int			     i;
+
+  for (target= k->oldest;  target && (target->id != id);  target= target->next)
+    ;
+  if (!target)
+    return 0;
+
+  for (c= k->oldest;  ;  c= c->next)
+    {
+      for (i= 0;  i < c->npages;  ++i)
+	memcpy(mpu->memory + 256 * c->page[i], c->data + 256 * i, 256);
+      if (c == target)
+	break;
+    }
+  *mpu->registers= target->registers;
+  mpu->cycles= target->cycles;
+  if (q->capacity < target->nevents)
+    {
+      if (!(q->heap= realloc(q->heap, target->nevents * sizeof(Event)))) outOfMemory();
+      q->capacity= target->nevents;
+    }
+  memcpy(q->heap, target->events, target->nevents * sizeof(Event));
+  q->size= target->nevents;
+  q->order= target->order;
+  q->held= target->held;
+  q->masked= 0;			/* eventsRun() will decide again */
+  eventsUpdate(mpu);
+  mpu->idle->key= IDLE_NONE;
+
+  /* the checkpoints after this one are no longer in the future */
+  while ((c= target->next))
+    {
+      target->next= c->next;
+      k->used -= checkpointSize(c);
+      checkpointFree(c);
+    }
+  k->newest= target;
+  k->id= target->id;
+  memset(k->dirty, 0, 256);
+  return 1;
+}
+
+
+void M6502_touch(M6502 *mpu, uint16_t first, uint16_t last)
+{
+  int page;
+  for (page= first >> 8;  page <= (last >> 8);  ++page)
+    mpu->checkpoints->dirty[page]= 1;
+}
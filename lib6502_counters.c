@@ -0,0 +1,114 @@
+/* lib6502_counters.c -- performance counters, coverage, heatmap	-*- C -*- */
+
+/* While counting is on M6502_run uses the DEBUG engine (the one that
+ * checks breakpoints and watchpoints), which counts every instruction
+ * it retires by opcode and every callback it invokes, and times the
+ * callbacks; the normal engines contain none of this.  The DEBUG
+ * engine neither fuses instructions nor skips idle loops, so the
+ * counts are exact but the emulation is slower.  Traps are counted as
+ * call callbacks (and are called through trapCall to time them).
+ * Interrupts are counted by M6502_irq and M6502_nmi.  The instruction
+ * and cycle totals are worked out when the counters are read.
+ *
+ * Coverage is recorded by the same engine: after each instruction it
+ * sets the bit for the instruction's address in the client's bitmap,
+ * which costs one store.  The heatmap is kept by the same engine too:
+ * every byte it reads or writes, whether through getMemory and
+ * putMemory or directly (operands, pointers in zero page, the stack),
+ * is counted at its address, as is the address of every instruction
+ * it executes.  Traps are native code, so the subroutines they replace
+ * are not seen to run and their accesses are not counted.
+ */
+
+#include <time.h>
+
+struct _M6502_Counting
+{
+  M6502_Counters counters;
+  uint64_t	 since;		/* cycle count at the last reset */
+};
+
+
+static int countCallback(M6502 *mpu, M6502_Callback callback, uint64_t *count, word addr, byte data)
+{
+  struct timespec start, end;
+  int		  result;
+
+  ++*count;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  result= callback(mpu, addr, data);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (mpu->counting)	/* the callback might have turned counting off */
+    mpu->counting->counters.callbackTime += (int64_t)(end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec);
+  return result;
+}
+
+
+void M6502_setCounting(M6502 *mpu, int enable)
+{
+  if (enable && !mpu->counting)
+    {
+      if (!(mpu->counting= calloc(1, sizeof(struct _M6502_Counting)))) outOfMemory();
+      if (!mpu->debug && !(mpu->debug= calloc(1, sizeof(M6502_Debug)))) outOfMemory();
+      mpu->counting->since= mpu->cycles;
+    }
+  else if (!enable && mpu->counting)
+    {
+      free(mpu->counting);
+      mpu->counting= 0;
+    }
+}
+
+
+int M6502_getCounters(M6502 *mpu, M6502_Counters *counters)
+{
+  int i;
+
+  if (!mpu->counting)
+    {
+      memset(counters, 0, sizeof(M6502_Counters));
+      return 0;
+    }
+  *counters= mpu->counting->counters;
+  counters->cycles= mpu->cycles - mpu->counting->since;
+  for (i= 0;  i < 256;  ++i)
+    counters->instructions += counters->opcodes[i];
+  return 1;
+}
+
+
+void M6502_resetCounters(M6502 *mpu)
+{
+  if (mpu->counting)
+    {
+      memset(&mpu->counting->counters, 0, sizeof(M6502_Counters));
+      mpu->counting->since= mpu->cycles;
+    }
+}
+
+
+void M6502_setCoverage(M6502 *mpu, uint8_t *bitmap)
+{
+  if (bitmap && !mpu->debug && !(mpu->debug= calloc(1, sizeof(M6502_Debug)))) outOfMemory();
+  mpu->coverage= bitmap;
+}
+
+
+void M6502_setHeatmap(M6502 *mpu, M6502_Heatmap *heatmap)
+{
+  if (heatmap && !mpu->debug && !(mpu->debug= calloc(1, sizeof(M6502_Debug)))) outOfMemory();
+  mpu->heatmap= heatmap;
+}
+
+
+static int heatCount(uint64_t *counts, int addr)
+{
+  ++counts[(word)addr];
+  return addr;
+}
+
+
+static void countersDelete(M6502 *mpu)
+{
+  M6502_setCounting(mpu, 0);
+}
@@ -0,0 +1,478 @@
+/* lib6502_debug.c -- breakpoints, watchpoints and stop conditions	-*- C -*- */
+
+/* Breakpoints stop the processor before it executes the instruction at
+ * a given address; watchpoints stop it after an instruction that reads
+ * or writes (as an operand, not as a push/pull or pointer fetch) an
+ * address in a given range.  Either can have a condition, such as
+ *
+ *	A == 0 && mem[$80] > 3
+ *
+ * that is compiled once into a small stack bytecode and evaluated only
+ * when the address matches.
+ *
+ * Instances with no breakpoints or watchpoints run in the normal
+ * engine, which contains no debugging code at all.  The moment one is
+ * set M6502_run switches to a second engine (generated from the same
+ * source with DEBUG defined as 1) that consults a table of per-page
+ * flags on each instruction and memory access, and looks further only
+ * on pages that have a breakpoint or watchpoint in them.
+ *
+ * Conditions are C expressions (with C precedence) over: numbers
+ * (decimal, $hex or 0xhex); the registers A X Y S P PC; the flags N V
+ * B D I Z C (0 or 1); mem[expr] (memory contents, read without
+ * invoking callbacks); addr and value (the address accessed and the
+ * byte read or written, for watchpoints); and the operators
+ *
+ *	() ! ~ - * / % + - << >> < <= > >= == != & ^ | && ||
+ */
+
+#include <ctype.h>
+#include <string.h>
+
+typedef struct _M6502_Debug M6502_Debug;
+
+#define DEBUG_STACK	32	/* maximum depth of a condition */
+#define DEBUG_HITS	4	/* watched accesses per instruction */
+
+enum {
+  opConst, opA, opX, opY, opS, opP, opPC, opFlag, opAddr, opValue, opMem,
+  opNot, opNeg, opCpl,
+  opMul, opDiv, opMod, opAdd, opSub, opShl, opShr,
+  opLt, opLe, opGt, opGe, opEq, opNe, opAnd, opXor, opOr, opLAnd, opLOr,
+  opEnd
+};
+
+typedef struct
+{
+  int	 id;
+  int	 access;	/* M6502_Break, M6502_WatchRead and/or M6502_WatchWrite */
+  word	 first, last;
+  long	*code;		/* compiled condition (0 if unconditional) */
+} DebugPoint;
+
+struct _M6502_Debug
+{
+  byte	      pages[256];	/* union of the access flags of points in each page */
+  DebugPoint *points;
+  int	      npoints, capacity, nextId;
+  struct {
+    word addr;
+    byte value;
+    byte access;
+  }	      hits[DEBUG_HITS];	/* watched accesses made by this instruction */
+  int	      nhits;
+  int	      resuming;		/* stopped at a breakpoint at resumePC */
+  word	      resumePC;
+  int	      stop;		/* the point that stopped the processor */
+  word	      stopAddr;
+  byte	      stopValue;
+  int	      stopAccess;
+};
+
+
+/* condition compiler */
+
+typedef struct
+{
+  const char *in;
+  long	     *code;
+  int	      size, capacity;
+  int	      depth, maxDepth;
+  int	      error;
+} Compiler;
+
+static void emit(Compiler *c, long value, int effect)
+{
+  if (c->size == c->capacity)
+    {
+      long *code;
+      c->capacity= c->capacity ? 2 * c->capacity : 32;
+      if (!(code= realloc(c->code, c->capacity * sizeof(long)))) outOfMemory();
+      c->code= code;
+    }
+  c->code[c->size++]= value;
+  if ((c->depth += effect) > c->maxDepth) c->maxDepth= c->depth;
+}
+
+static void skipSpace(Compiler *c)
+{
+  while (isspace(*c->in)) ++c->in;
+}
+
+static int accept(Compiler *c, const char *token)
+{
+  size_t len= strlen(token);
+  skipSpace(c);
+  if (strncmp(c->in, token, len)) return 0;
+  /* don't take '<' from '<<', '&' from '&&', etc. */
+  if ((1 == len) && strchr("<>&|=", token[0]) && (c->in[1] == token[0])) return 0;
+  if ((1 == len) && strchr("<>!", token[0]) && ('=' == c->in[1])) return 0;
+  c->in += len;
+  return 1;
+}
+
+static void expression(Compiler *c);
+
+static void primary(Compiler *c)
+{
+  static struct { const char *name;  int op;  long arg; } names[]= {
+    { "pc", opPC, 0 },  { "a", opA, 0 },  { "x", opX, 0 },  { "y", opY, 0 },
+    { "s", opS, 0 },  { "p", opP, 0 },
+    { "n", opFlag, flagN },  { "v", opFlag, flagV },  { "b", opFlag, flagB },
+    { "d", opFlag, flagD },  { "i", opFlag, flagI },  { "z", opFlag, flagZ },
+    { "c", opFlag, flagC },
+    { "addr", opAddr, 0 },  { "value", opValue, 0 },
+    { 0, 0, 0 }
+  };
+  skipSpace(c);
+  if (accept(c, "("))
+    {
+      expression(c);
+      if (!accept(c, ")")) c->error= 1;
+    }
+  else if (isdigit(*c->in) || ('$' == *c->in))
+    {
+      char *end;
+      long  value= ('$' == *c->in) ? strtol(c->in + 1, &end, 16)
+		 : (('0' == c->in[0]) && ('x' == tolower(c->in[1]))) ? strtol(c->in, &end, 16)
+		 : strtol(c->in, &end, 10);
+      if (end == c->in + ('$' == *c->in)) c->error= 1;
+      c->in= end;
+      emit(c, opConst, 1);
+      emit(c, value, 0);
+    }
+  else if (isalpha(*c->in))
+    {
+      char   name[8];
+      size_t len= 0;
+      int    i;
+      while (isalnum(c->in[len]) && (len < sizeof(name) - 1))
+	{
+	  name[len]= tolower(c->in[len]);
+	  ++len;
+	}
+      name[len]= '\0';
+      c->in += len;
+      if (!strcmp(name, "mem"))
+	{
+	  if (!accept(c, "[")) c->error= 1;
+	  expression(c);
+	  if (!accept(c, "]")) c->error= 1;
+	  emit(c, opMem, 0);
+	  return;
+	}
+      for (i= 0;  names[i].name;  ++i)
+	if (!strcmp(name, names[i].name))
+	  {
+	    emit(c, names[i].op, 1);
+	    if (opFlag == names[i].op) emit(c, names[i].arg, 0);
+	    return;
+	  }
+      c->error= 1;
+    }
+  else
+    c->error= 1;
+}
+
+static void unary(Compiler *c)
+{
+  if      (accept(c, "!"))  { unary(c);  emit(c, opNot, 0); }
+  else if (accept(c, "-"))  { unary(c);  emit(c, opNeg, 0); }
+  else if (accept(c, "~"))  { unary(c);  emit(c, opCpl, 0); }
+  else			      primary(c);
+}
+
+/* binary operators, loosest first; each level is a list of token/op pairs */
+
+static struct { const char *token;  int op; } binaries[][5]= {
+  { { "||", opLOr } },
+  { { "&&", opLAnd } },
+  { { "|",  opOr } },
+  { { "^",  opXor } },
+  { { "&",  opAnd } },
+  { { "==", opEq }, { "!=", opNe } },
+  { { "<=", opLe }, { ">=", opGe }, { "<", opLt }, { ">", opGt } },
+  { { "<<", opShl }, { ">>", opShr } },
+  { { "+",  opAdd }, { "-", opSub } },
+  { { "*",  opMul }, { "/", opDiv }, { "%", opMod } },
+};
+
+static void binary(Compiler *c, int level)
+{
+  int i;
+  if (level == sizeof(binaries) / sizeof(*binaries))
+    {
+      unary(c);
+      return;
+    }
+  binary(c, level + 1);
+  for (i= 0;  !c->error && binaries[level][i].token;  )
+    if (accept(c, binaries[level][i].token))
+      {
+	binary(c, level + 1);
+	emit(c, binaries[level][i].op, -1);
+	i= 0;
+      }
+    else
+      ++i;
+}
+
+static void expression(Compiler *c)
+{
+  if (!c->error) binary(c, 0);
+}
+
+/* answers the compiled condition, or 0 (and *error non-zero) if it is
+ * malformed or too deep to evaluate */
+
+static long *debugCompile(const char *source, int *error)
+{
+  Compiler c;
+  memset(&c, 0, sizeof(c));
+  c.in= source;
+  expression(&c);
+  skipSpace(&c);
+  emit(&c, opEnd, 0);
+  if (c.error || *c.in || (c.maxDepth > DEBUG_STACK))
+    {
+      free(c.code);
+      *error= 1;
+      return 0;
+    }
+  return c.code;
+}
+
+
+static long debugEvaluate(M6502 *mpu, long *code, word addr, byte value)
+{
+  long stack[DEBUG_STACK + 1], *sp= stack;	/* stack[0] unused */
+  M6502_Registers *r= mpu->registers;
+
+  for (;;)
+    switch (*code++)
+      {
+      case opConst:	*++sp= *code++;				break;
+      case opA:		*++sp= r->a;				break;
+      case opX:		*++sp= r->x;				break;
+      case opY:		*++sp= r->y;				break;
+      case opS:		*++sp= r->s;				break;
+      case opP:		*++sp= r->p;				break;
+      case opPC:	*++sp= r->pc;				break;
+      case opFlag:	*++sp= !!(r->p & *code++);		break;
+      case opAddr:	*++sp= addr;				break;
+      case opValue:	*++sp= value;				break;
+      case opMem:	*sp= mpu->memory[*sp & 0xffff];		break;
+      case opNot:	*sp= !*sp;				break;
+      case opNeg:	*sp= -*sp;				break;
+      case opCpl:	*sp= ~*sp;				break;
+#     define binop(OP, EXPR)	case OP:  --sp;  *sp= (EXPR);	break
+      binop(opMul,  sp[0] *  sp[1]);
+      binop(opDiv,  sp[1] ? sp[0] / sp[1] : 0);
+      binop(opMod,  sp[1] ? sp[0] % sp[1] : 0);
+      binop(opAdd,  sp[0] +  sp[1]);
+      binop(opSub,  sp[0] -  sp[1]);
+      binop(opShl,  sp[0] << (sp[1] & 31));
+      binop(opShr,  sp[0] >> (sp[1] & 31));
+      binop(opLt,   sp[0] <  sp[1]);
+      binop(opLe,   sp[0] <= sp[1]);
+      binop(opGt,   sp[0] >  sp[1]);
+      binop(opGe,   sp[0] >= sp[1]);
+      binop(opEq,   sp[0] == sp[1]);
+      binop(opNe,   sp[0] != sp[1]);
+      binop(opAnd,  sp[0] &  sp[1]);
+      binop(opXor,  sp[0] ^  sp[1]);
+      binop(opOr,   sp[0] |  sp[1]);
+      binop(opLAnd, sp[0] && sp[1]);
+      binop(opLOr,  sp[0] || sp[1]);
+#     undef binop
+      case opEnd:	return *sp;
+      }
+}
+
+
+/* setting and clearing points */
+
+static void debugUpdatePages(M6502_Debug *debug)
+{
+  int i;
+  unsigned page;
+  memset(debug->pages, 0, sizeof(debug->pages));
+  for (i= 0;  i < debug->npoints;  ++i)
+    for (page= debug->points[i].first >> 8;  page <= (debug->points[i].last >> 8);  ++page)
+      debug->pages[page] |= debug->points[i].access;
+}
+
+static int debugAdd(M6502 *mpu, word first, word last, int access, const char *condition)
+{
+  M6502_Debug *debug= mpu->debug;
+  DebugPoint  *p;
+  long	      *code= 0;
+  int	       error= 0;
+
+  if ((first > last) || !access || (access & ~(M6502_Break | M6502_WatchRead | M6502_WatchWrite)))
+    return 0;
+  if (condition && *condition && !(code= debugCompile(condition, &error)))
+    return 0;
+  if (!debug && !(debug= mpu->debug= calloc(1, sizeof(M6502_Debug))))
+    outOfMemory();
+  if (debug->npoints == debug->capacity)
+    {
+      int capacity= debug->capacity ? 2 * debug->capacity : 8;
+      if (!(p= realloc(debug->points, capacity * sizeof(DebugPoint)))) outOfMemory();
+      debug->points= p;
+      debug->capacity= capacity;
+    }
+  p= debug->points + debug->npoints++;
+  p->id=     ++debug->nextId;
+  p->access= access;
+  p->first=  first;
+  p->last=   last;
+  p->code=   code;
+  debugUpdatePages(debug);
+  return p->id;
+}
+
+int M6502_setBreakpoint(M6502 *mpu, uint16_t addr, const char *condition)
+{
+  return debugAdd(mpu, addr, addr, M6502_Break, condition);
+}
+
+int M6502_setWatchpoint(M6502 *mpu, uint16_t first, uint16_t last, int access, const char *condition)
+{
+  return debugAdd(mpu, first, last, access & (M6502_WatchRead | M6502_WatchWrite), condition);
+}
+
+int M6502_clearBreakpoint(M6502 *mpu, int id)
+{
+  M6502_Debug *debug= mpu->debug;
+  int i;
+  if (debug)
+    for (i= 0;  i < debug->npoints;  ++i)
+      if (debug->points[i].id == id)
+	{
+	  free(debug->points[i].code);
+	  debug->points[i]= debug->points[--debug->npoints];
+	  debugUpdatePages(debug);
+	  return 1;
+	}
+  return 0;
+}
+
+int M6502_stopped(M6502 *mpu, char buffer[64])
+{
+  M6502_Debug *debug= mpu->debug;
+  if (!debug || !debug->stop)
+    return 0;
+  if (buffer)
+    {
+      if (M6502_Break == debug->stopAccess)
+	sprintf(buffer, "breakpoint %d at %04X", debug->stop, debug->stopAddr);
+      else
+	sprintf(buffer, "watchpoint %d: %s %02X %s %04X", debug->stop,
+		(M6502_WatchRead == debug->stopAccess) ? "read" : "wrote", debug->stopValue,
+		(M6502_WatchRead == debug->stopAccess) ? "from" : "to", debug->stopAddr);
+    }
+  return debug->stop;
+}
+
+static void debugDelete(M6502 *mpu)
+{
+  M6502_Debug *debug= mpu->debug;
+  int i;
+  if (debug)
+    {
+      for (i= 0;  i < debug->npoints;  ++i)
+	free(debug->points[i].code);
+      free(debug->points);
+      free(debug);
+      mpu->debug= 0;
+    }
+}
+
+
+/* called from the DEBUG engine; the page flags have already matched */
+
+static byte debugAccess(M6502 *mpu, word addr, byte value, int access)
+{
+  M6502_Debug *debug= mpu->debug;
+  int i;
+  for (i= 0;  i < debug->npoints;  ++i)
+    if ((debug->points[i].access & access) && (addr >= debug->points[i].first) && (addr <= debug->points[i].last))
+      {
+	if (debug->nhits < DEBUG_HITS)
+	  {
+	    debug->hits[debug->nhits].addr=   addr;
+	    debug->hits[debug->nhits].value=  value;
+	    debug->hits[debug->nhits].access= access;
+	    ++debug->nhits;
+	  }
+	break;
+      }
+  return value;
+}
+
+static int debugStop(M6502_Debug *debug, DebugPoint *p, word addr, byte value, int access)
+{
+  debug->stop=       p->id;
+  debug->stopAddr=   addr;
+  debug->stopValue=  value;
+  debug->stopAccess= access;
+  return 1;
+}
+
+/* at the end of an instruction (registers externalised): answers
+ * non-zero if a watched access satisfied its condition */
+
+static int debugWatched(M6502 *mpu)
+{
+  M6502_Debug *debug= mpu->debug;
+  int h, i, n= debug->nhits;
+  debug->nhits= 0;
+  for (h= 0;  h < n;  ++h)
+    for (i= 0;  i < debug->npoints;  ++i)
+      {
+	DebugPoint *p= debug->points + i;
+	word addr= debug->hits[h].addr;
+	if ((p->access & debug->hits[h].access) && (addr >= p->first) && (addr <= p->last)
+	    && (!p->code || debugEvaluate(mpu, p->code, addr, debug->hits[h].value)))
+	  return debugStop(debug, p, addr, debug->hits[h].value, debug->hits[h].access);
+      }
+  return 0;
+}
+
+/* before executing the instruction at pc: answers non-zero if a
+ * breakpoint there satisfies its condition */
+
+static int debugBreak(M6502 *mpu, word pc)
+{
+  M6502_Debug *debug= mpu->debug;
+  int i;
+  for (i= 0;  i < debug->npoints;  ++i)
+    {
+      DebugPoint *p= debug->points + i;
+      if ((M6502_Break == p->access) && (pc == p->first)
+	  && (!p->code || debugEvaluate(mpu, p->code, pc, 0)))
+	{
+	  debug->resuming= 1;
+	  debug->resumePC= pc;
+	  return debugStop(debug, p, pc, 0, M6502_Break);
+	}
+    }
+  return 0;
+}
+
+/* on entry to the DEBUG engine: answers non-zero if the processor
+ * should stop before executing anything.  the breakpoint that caused
+ * the previous stop (if any) is not checked again, so that execution
+ * can resume from it. */
+
+static int debugEnter(M6502 *mpu)
+{
+  M6502_Debug *debug= mpu->debug;
+  word pc= mpu->registers->pc;
+  int  resuming= debug->resuming && (debug->resumePC == pc);
+  debug->resuming= 0;
+  debug->stop= 0;
+  debug->nhits= 0;
+  return !resuming && (debug->pages[pc >> 8] & M6502_Break) && debugBreak(mpu, pc);
+}
@@ -1,34 +1,202 @@
 
 #include <string.h>
+#include <ctype.h>
+#include <pthread.h>
 
-int M6502_disassemble(M6502 *mpu, word ip, char buffer[64])
+/* the disassembler is driven by a table of the instructions of each
+ * model, built from do_insns the first time an instance is created.
+ * the 65C02 instructions are 'ill' (one byte) for the NMOS model.
+ */
+
+enum { dumpImplied, dumpImmediate, dumpZp, dumpZpx, dumpZpy, dumpAbs, dumpAbsx, dumpAbsy,
+       dumpRelative, dumpIndirect, dumpIndzp, dumpIndx, dumpIndy, dumpIndabsx };
+
+static const struct
+{
+  const char	*before, *after;	/* around the operand */
+  byte		 length;		/* of the instruction */
+} dumpModes[]= {
+  [dumpImplied]=   { "",   "",    1 },
+  [dumpImmediate]= { "#",  "",    2 },
+  [dumpZp]=	   { "",   "",    2 },
+  [dumpZpx]=	   { "",   ",X",  2 },
+  [dumpZpy]=	   { "",   ",Y",  2 },
+  [dumpAbs]=	   { "",   "",    3 },
+  [dumpAbsx]=	   { "",   ",X",  3 },
+  [dumpAbsy]=	   { "",   ",Y",  3 },
+  [dumpRelative]=  { "",   "",    2 },
+  [dumpIndirect]=  { "(",  ")",   3 },
+  [dumpIndzp]=	   { "(",  ")",   2 },
+  [dumpIndx]=	   { "(",  ",X)", 2 },
+  [dumpIndy]=	   { "(",  "),Y", 2 },
+  [dumpIndabsx]=   { "(",  ",X)", 3 },
+};
+
+#define dump_implied	dumpImplied
+#define dump_immediate	dumpImmediate
+#define dump_zp		dumpZp
+#define dump_zpx	dumpZpx
+#define dump_zpy	dumpZpy
+#define dump_abs	dumpAbs
+#define dump_absx	dumpAbsx
+#define dump_absy	dumpAbsy
+#define dump_relative	dumpRelative
+#define dump_indirect	dumpIndirect
+#define dump_indzp	dumpIndzp
+#define dump_indx	dumpIndx
+#define dump_indy	dumpIndy
+#define dump_indabsx	dumpIndabsx
+
+static struct
+{
+  char	name[6];
+  byte	mode;
+  byte	length;
+  byte	cycles;
+} dumpInsns[2][256];	/* [model][opcode] */
+
+static const char dumpHex[]= "0123456789ABCDEF";
+
+
+static void dumpBuild(void)
+{
+# define dumpSet(MODEL, NUM, NAME, MODE, CYCLES)					\
+  strcpy(dumpInsns[MODEL][0x##NUM].name, NAME);						\
+  dumpInsns[MODEL][0x##NUM].mode=   MODE;							\
+  dumpInsns[MODEL][0x##NUM].length= dumpModes[MODE].length;				\
+  dumpInsns[MODEL][0x##NUM].cycles= CYCLES
+# define dumpOp(num, name, mode, cycles)	dumpSet(M6502_NMOS, num, #name, dump_##mode, cycles);  dumpSet(M6502_CMOS, num, #name, dump_##mode, cycles)
+# define dumpCmos(num, name, mode, cycles)	dumpSet(M6502_NMOS, num, "ill", dumpImplied, cycles);  dumpSet(M6502_CMOS, num, #name, dump_##mode, cycles)
+  do_insns(dumpOp, dumpCmos);
+# undef dumpOp
+# undef dumpCmos
+# undef dumpSet
+}
+
+/* instances may be created in several threads at once */
+
+static void dumpInit(void)
 {
-  char *s= buffer;
-  byte *b= mpu->memory + ip;
+  static pthread_once_t once= PTHREAD_ONCE_INIT;
+  pthread_once(&once, dumpBuild);
+}
+
+
+static char *dumpByte(char *s, byte b)
+{
+  s[0]= dumpHex[b >> 4];
+  s[1]= dumpHex[b & 15];
+  return s + 2;
+}
+
 
-  switch (b[0])
+static char *dumpWord(char *s, word w)
+{
+  return dumpByte(dumpByte(s, w >> 8), w);
+}
+
+
+static char *dumpString(char *s, const char *t)
+{
+  while (*t) *s++= *t++;
+  return s;
+}
+
+
+/* write the instruction at ip (without a terminating NUL) and answer
+ * the end of it.  *operand is set to the address it refers to, or -1.
+ */
+
+static char *dumpInsn(M6502 *mpu, word ip, char *s, int *operand)
+{
+  byte *m= mpu->memory;
+  int	op= m[ip], mode= dumpInsns[mpu->model][op].mode;
+  byte	lo= m[(word)(ip + 1)], hi= m[(word)(ip + 2)];
+
+  s= dumpString(s, dumpInsns[mpu->model][op].name);
+  *s++= ' ';
+  s= dumpString(s, dumpModes[mode].before);
+  switch (dumpModes[mode].length)
     {
-#    define _implied							    return 1;
-#    define _immediate	sprintf(s, "#%02X",	   b[1]);		    return 2;
-#    define _zp		sprintf(s, "%02X",	   b[1]);		    return 2;
-#    define _zpx	sprintf(s, "%02X,X",	   b[1]);		    return 2;
-#    define _zpy	sprintf(s, "%02X,Y",	   b[1]);		    return 2;
-#    define _abs	sprintf(s, "%02X%02X",	   b[2], b[1]);		    return 3;
-#    define _absx	sprintf(s, "%02X%02X,X",   b[2], b[1]);		    return 3;
-#    define _absy	sprintf(s, "%02X%02X,Y",   b[2], b[1]);		    return 3;
-#    define _relative	sprintf(s, "%04X",	   ip + 2 + (int8_t)b[1]);  return 2;
-#    define _indirect	sprintf(s, "(%02X%02X)",   b[2], b[1]);		    return 3;
-#    define _indzp	sprintf(s, "(%02X)",	   b[1]);		    return 2;
-#    define _indx	sprintf(s, "(%02X,X)",	   b[1]);		    return 2;
-#    define _indy	sprintf(s, "(%02X),Y",	   b[1]);		    return 2;
-#    define _indabsx	sprintf(s, "(%02X%02X,X)", b[2], b[1]);		    return 3;
-
-#    define disassemble(num, name, mode, cycles) case 0x##num: s += sprintf(s, "%s ", #name); _##mode
-      do_insns(disassemble);
-#    undef _do
+    case 1:
+      *operand= -1;
+      break;
+    case 2:
+      if (dumpRelative == mode)
+	s= dumpWord(s, *operand= (word)(ip + 2 + (int8_t)lo));
+      else
+	{
+	  s= dumpByte(s, lo);
+	  *operand= (dumpImmediate == mode) ? -1 : lo;
+	}
+      break;
+    case 3:
+      s= dumpWord(s, *operand= lo | (hi << 8));
+      break;
     }
+  return dumpString(s, dumpModes[mode].after);
+}
+
+
+int M6502_disassemble(M6502 *mpu, word ip, char buffer[64])
+{
+  int operand;
+  *dumpInsn(mpu, ip, buffer, &operand)= '\0';
+  return dumpInsns[mpu->model][mpu->memory[ip]].length;
+}
 
-  return 0;
+
+/* one line per instruction, as run6502 -d prints them:
+ *
+ *	AAAA HHHHHH CCC insn [; symbol]
+ *
+ * with the address, up to three bytes in hex and as characters, and
+ * any symbol for the operand.  a symbol for the address itself is
+ * written on a line of its own before it, followed by a colon.
+ */
+
+#define DUMP_SYMBOL	80	/* longest symbol written */
+#define DUMP_LINE	(40 + 2 * (DUMP_SYMBOL + 4))
+
+unsigned M6502_disassembleRange(M6502 *mpu, uint16_t address, unsigned length, char *buffer, size_t size,
+				M6502_Symbols symbols, void *data)
+{
+  unsigned done= 0;
+  char	  *s= buffer, *end= buffer + size;
+
+  while ((done < length) && (end - s > DUMP_LINE))
+    {
+      word	  ip= address + done;
+      byte	 *m= mpu->memory;
+      int	  n= dumpInsns[mpu->model][m[ip]].length, i, operand;
+      const char *name;
+
+      if (symbols && (name= symbols(data, ip)))
+	{
+	  for (i= 0;  name[i] && (i < DUMP_SYMBOL);  ++i) *s++= name[i];
+	  *s++= ':';
+	  *s++= '\n';
+	}
+      s= dumpWord(s, ip);
+      *s++= ' ';
+      for (i= 0;  i < 3;  ++i)
+	if (i < n)  s= dumpByte(s, m[(word)(ip + i)]);
+	else	    *s++= ' ', *s++= ' ';
+      *s++= ' ';
+      for (i= 0;  i < 3;  ++i)
+	*s++= ((i < n) && isgraph(m[(word)(ip + i)])) ? m[(word)(ip + i)] : ' ';
+      *s++= ' ';
+      s= dumpInsn(mpu, ip, s, &operand);
+      if (symbols && (operand >= 0) && (name= symbols(data, operand)))
+	{
+	  s= dumpString(s, " ; ");
+	  for (i= 0;  name[i] && (i < DUMP_SYMBOL);  ++i) *s++= name[i];
+	}
+      *s++= '\n';
+      done += n;
+    }
+  if (s < end) *s= '\0';
+  return done;
 }
 
 
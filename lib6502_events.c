@@ -0,0 +1,295 @@
+/* lib6502_events.c -- cycle-keyed event queue	-*- C -*- */
+
+/* Each instance has a binary min-heap of pending events ordered by the
+ * cycle at which they fall due (events due on the same cycle run in
+ * the order they were scheduled).  mpu->deadline caches the cycle of
+ * the earliest event so that the run loop makes one comparison per
+ * instruction to decide whether anything is due, and calls
+ * eventsRun() only when something is.
+ *
+ * M6502_signal() uses the same comparison to get the attention of the
+ * run loop from outside it (a signal handler, typically): it sets a
+ * flag and zeroes the deadline, and eventsRun() calls the handler
+ * installed with M6502_setSignal() at the next instruction boundary.
+ * Both are plain stores, so it is safe to call from a signal handler.
+ *
+ * The IRQ and NMI lines (M6502_setIRQ() and M6502_setNMI()) work the
+ * same way but can be driven from any thread: the lines are atomic, and
+ * so are the loads and stores of the deadline (a relaxed load is an
+ * ordinary one on the hosts that matter, so the run loop pays nothing
+ * for it).  Raising a line zeroes the deadline after setting it, and
+ * eventsUpdate() checks the lines after storing a new deadline, so a
+ * line raised while the run loop is updating the deadline is never
+ * lost.  An interrupt is taken at the end of the instruction that is
+ * executing when the line is raised.
+ *
+ * An interrupt request (from the line or M6502_scheduleIRQ()) that
+ * finds I set is marked as masked and costs nothing until I is cleared:
+ * the instructions that can clear it (CLI, PLP and RTI) and the other
+ * places where P changes (traps, and the start of M6502_run()) use
+ * unmask() to zero the deadline again, and the request is taken at the
+ * end of that instruction.
+ */
+
+#define NEVER	(~(uint64_t)0)
+
+#define eventsDeadline(MPU)	__atomic_load_n(&(MPU)->deadline, __ATOMIC_RELAXED)
+
+typedef struct
+{
+  uint64_t	when;
+  unsigned long	order;	/* tie-break: scheduling order */
+  M6502_Event	event;
+  void	       *data;
+} Event;
+
+struct _M6502_Events
+{
+  int		size;
+  int		capacity;
+  unsigned long	order;
+  Event	       *heap;
+  volatile int	signalled;	/* M6502_signal() since the last eventsRun() */
+  M6502_Event	signal;
+  void	       *signalData;
+  int		irq;		/* level of the IRQ line (atomic) */
+  int		nmi;		/* level of the NMI line (atomic) */
+  int		nmiEdge;	/* NMI raised since the last one was taken (atomic) */
+  int		held;		/* M6502_scheduleIRQ() not yet taken */
+  int		masked;		/* an interrupt request is waiting for I to clear */
+};
+
+#define eventBefore(E, F)	(((E)->when < (F)->when) || (((E)->when == (F)->when) && ((E)->order < (F)->order)))
+
+
+static void eventsSiftUp(Event *heap, int i)
+{
+  Event e= heap[i];
+  while (i > 0)
+    {
+      int parent= (i - 1) / 2;
+      if (!eventBefore(&e, heap + parent)) break;
+      heap[i]= heap[parent];
+      i= parent;
+    }
+  heap[i]= e;
+}
+
+
+static void eventsSiftDown(Event *heap, int size, int i)
+{
+  Event e= heap[i];
+  for (;;)
+    {
+      int child= 2 * i + 1;
+      if (child >= size) break;
+      if ((child + 1 < size) && eventBefore(heap + child + 1, heap + child)) ++child;
+      if (!eventBefore(heap + child, &e)) break;
+      heap[i]= heap[child];
+      i= child;
+    }
+  heap[i]= e;
+}
+
+
+/* non-zero if something other than an event needs the run loop */
+
+static int eventsAttention(struct _M6502_Events *q)
+{
+  return q->signalled
+    || __atomic_load_n(&q->nmiEdge, __ATOMIC_SEQ_CST)
+    || (!q->masked && (q->held || __atomic_load_n(&q->irq, __ATOMIC_SEQ_CST)));
+}
+
+
+static void eventsUpdate(M6502 *mpu)
+{
+  struct _M6502_Events *q= mpu->events;
+  __atomic_store_n(&mpu->deadline, q->size ? q->heap[0].when : NEVER, __ATOMIC_SEQ_CST);
+  if (eventsAttention(q))		/* after the store, to catch a line raised meanwhile */
+    __atomic_store_n(&mpu->deadline, 0, __ATOMIC_SEQ_CST);
+}
+
+
+/* run every event that is due.  called from the run loop (with the
+ * registers externalised) when mpu->cycles reaches mpu->deadline.
+ * events may schedule further events, including ones that are already
+ * due, and those run too.
+ */
+
+static void eventsRun(M6502 *mpu)
+{
+  struct _M6502_Events *q= mpu->events;
+  if (q->signalled)
+    {
+      q->signalled= 0;
+      if (q->signal) q->signal(mpu, mpu->cycles, q->signalData);
+    }
+  if (__atomic_exchange_n(&q->nmiEdge, 0, __ATOMIC_SEQ_CST))
+    M6502_nmi(mpu);
+  while (q->size && (q->heap[0].when <= mpu->cycles))
+    {
+      Event e= q->heap[0];
+      if (--q->size)
+	{
+	  q->heap[0]= q->heap[q->size];
+	  eventsSiftDown(q->heap, q->size, 0);
+	}
+      e.event(mpu, e.when, e.data);
+    }
+  if (q->held || __atomic_load_n(&q->irq, __ATOMIC_RELAXED))
+    {
+      q->masked= !!(mpu->registers->p & flagI);	/* until unmask() */
+      if (!q->masked)
+	{
+	  q->held= 0;
+	  M6502_irq(mpu);
+	}
+    }
+  eventsUpdate(mpu);
+}
+
+
+/* called by unmask() when I has been cleared with a request masked */
+
+static void eventsUnmask(M6502 *mpu)
+{
+  mpu->events->masked= 0;
+  __atomic_store_n(&mpu->deadline, 0, __ATOMIC_SEQ_CST);
+}
+
+
+/* the lines can be raised by other threads as soon as the instance
+ * exists, so the queue is not created lazily */
+
+static void eventsNew(M6502 *mpu)
+{
+  if (!(mpu->events= calloc(1, sizeof(struct _M6502_Events)))) outOfMemory();
+  eventsUpdate(mpu);
+}
+
+
+static void eventsDelete(M6502 *mpu)
+{
+  if (mpu->events)
+    {
+      free(mpu->events->heap);
+      free(mpu->events);
+      mpu->events= 0;
+    }
+}
+
+
+void M6502_schedule(M6502 *mpu, uint64_t when, M6502_Event event, void *data)
+{
+  struct _M6502_Events *q= mpu->events;
+  Event *e;
+
+  if (q->size == q->capacity)
+    {
+      int capacity= q->capacity ? 2 * q->capacity : 16;
+      Event *heap= realloc(q->heap, capacity * sizeof(Event));
+      if (!heap) outOfMemory();
+      q->heap= heap;
+      q->capacity= capacity;
+    }
+  e= q->heap + q->size;
+  e->when=  when;
+  e->order= q->order++;
+  e->event= event;
+  e->data=  data;
+  eventsSiftUp(q->heap, q->size++);
+  eventsUpdate(mpu);
+}
+
+
+void M6502_setSignal(M6502 *mpu, M6502_Event handler, void *data)
+{
+  mpu->events->signal= handler;
+  mpu->events->signalData= data;
+}
+
+
+void M6502_signal(M6502 *mpu)
+{
+  mpu->events->signalled= 1;
+  mpu->deadline= 0;
+}
+
+
+void M6502_setIRQ(M6502 *mpu, int level)
+{
+  __atomic_store_n(&mpu->events->irq, !!level, __ATOMIC_SEQ_CST);
+  if (level)
+    __atomic_store_n(&mpu->deadline, 0, __ATOMIC_SEQ_CST);
+}
+
+
+/* the NMI input is edge-sensitive: raising it (from low) latches a
+ * request that is taken once, however long the line is then held */
+
+void M6502_setNMI(M6502 *mpu, int level)
+{
+  if (!__atomic_exchange_n(&mpu->events->nmi, !!level, __ATOMIC_SEQ_CST) && level)
+    {
+      __atomic_store_n(&mpu->events->nmiEdge, 1, __ATOMIC_SEQ_CST);
+      __atomic_store_n(&mpu->deadline, 0, __ATOMIC_SEQ_CST);
+    }
+}
+
+
+int M6502_cancel(M6502 *mpu, M6502_Event event, void *data)
+{
+  struct _M6502_Events *q= mpu->events;
+  int i, n= 0;
+
+  for (i= 0;  i < q->size;  ++i)
+    if ((q->heap[i].event == event) && (q->heap[i].data == data))
+      ++n;
+    else
+      q->heap[i - n]= q->heap[i];
+  if (n)
+    {
+      q->size -= n;
+      for (i= q->size / 2 - 1;  i >= 0;  --i)
+	eventsSiftDown(q->heap, q->size, i);
+      eventsUpdate(mpu);
+    }
+  return n;
+}
+
+
+/* an interrupt request that arrives while interrupts are disabled is
+ * held (like the level-sensitive IRQ line) and taken on the first
+ * instruction boundary after the I flag is cleared.  any number of
+ * them held together are taken as one.
+ */
+
+static void eventIRQ(M6502 *mpu, uint64_t when, void *data)
+{
+  if (mpu->registers->p & flagI)
+    mpu->events->held= 1;	/* see eventsRun() */
+  else
+    M6502_irq(mpu);
+}
+
+
+static void eventNMI(M6502 *mpu, uint64_t when, void *data)
+{
+  M6502_nmi(mpu);
+}
+
+
+void M6502_scheduleIRQ(M6502 *mpu, uint64_t when)
+{
+  M6502_schedule(mpu, when, eventIRQ, 0);
+}
+
+
+void M6502_scheduleNMI(M6502 *mpu, uint64_t when)
+{
+  M6502_schedule(mpu, when, eventNMI, 0);
+}
+
+
+#undef eventBefore
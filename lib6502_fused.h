@@ -0,0 +1,270 @@
+/* lib6502_fused.h -- superinstructions			-*- C -*- */
+
+/* Generated by bench/fuse.pl from the profiles of: bcd callback crc32 memcpy sieve
+ * Do not edit; run 'make fused' to regenerate.
+ *
+ * fused_XX(F, F3) lists the instructions that are executed in the same
+ * dispatch as opcode XX when they follow it, as
+ *
+ *	F(op, name, mode, cycles, cmos)
+ *
+ * for a pair and F3 with the same five for each of the second and third
+ * instructions of a triple.  cmos is 1 for 65C02-only instructions.
+ */
+
+#define fused_00(F, F3)
+#define fused_01(F, F3)
+#define fused_02(F, F3)
+#define fused_03(F, F3)
+#define fused_04(F, F3)
+#define fused_05(F, F3)
+#define fused_06(F, F3)
+#define fused_07(F, F3)
+#define fused_08(F, F3)
+#define fused_09(F, F3)
+#define fused_0a(F, F3)
+#define fused_0b(F, F3)
+#define fused_0c(F, F3)
+#define fused_0d(F, F3)
+#define fused_0e(F, F3)
+#define fused_0f(F, F3)
+#define fused_10(F, F3)
+#define fused_11(F, F3)
+#define fused_12(F, F3)
+#define fused_13(F, F3)
+#define fused_14(F, F3)
+#define fused_15(F, F3)
+#define fused_16(F, F3)
+#define fused_17(F, F3)
+#define fused_18(F, F3)  F3(a5, lda, zp, 3, 0,  65, adc, zp, 3, 0)
+#define fused_19(F, F3)
+#define fused_1a(F, F3)
+#define fused_1b(F, F3)
+#define fused_1c(F, F3)
+#define fused_1d(F, F3)
+#define fused_1e(F, F3)
+#define fused_1f(F, F3)
+#define fused_20(F, F3)
+#define fused_21(F, F3)
+#define fused_22(F, F3)
+#define fused_23(F, F3)
+#define fused_24(F, F3)
+#define fused_25(F, F3)
+#define fused_26(F, F3)
+#define fused_27(F, F3)
+#define fused_28(F, F3)
+#define fused_29(F, F3)
+#define fused_2a(F, F3)
+#define fused_2b(F, F3)
+#define fused_2c(F, F3)
+#define fused_2d(F, F3)
+#define fused_2e(F, F3)
+#define fused_2f(F, F3)
+#define fused_30(F, F3)
+#define fused_31(F, F3)
+#define fused_32(F, F3)
+#define fused_33(F, F3)
+#define fused_34(F, F3)
+#define fused_35(F, F3)
+#define fused_36(F, F3)
+#define fused_37(F, F3)
+#define fused_38(F, F3)
+#define fused_39(F, F3)
+#define fused_3a(F, F3)
+#define fused_3b(F, F3)
+#define fused_3c(F, F3)
+#define fused_3d(F, F3)
+#define fused_3e(F, F3)
+#define fused_3f(F, F3)
+#define fused_40(F, F3)
+#define fused_41(F, F3)
+#define fused_42(F, F3)
+#define fused_43(F, F3)
+#define fused_44(F, F3)
+#define fused_45(F, F3)  F3(85, sta, zp, 2, 0,  c8, iny, implied, 2, 0)  F3(aa, tax, implied, 2, 0,  a5, lda, zp, 3, 0)
+#define fused_46(F, F3)
+#define fused_47(F, F3)
+#define fused_48(F, F3)
+#define fused_49(F, F3)
+#define fused_4a(F, F3)
+#define fused_4b(F, F3)
+#define fused_4c(F, F3)
+#define fused_4d(F, F3)
+#define fused_4e(F, F3)
+#define fused_4f(F, F3)
+#define fused_50(F, F3)
+#define fused_51(F, F3)
+#define fused_52(F, F3)
+#define fused_53(F, F3)
+#define fused_54(F, F3)
+#define fused_55(F, F3)
+#define fused_56(F, F3)
+#define fused_57(F, F3)
+#define fused_58(F, F3)
+#define fused_59(F, F3)
+#define fused_5a(F, F3)
+#define fused_5b(F, F3)
+#define fused_5c(F, F3)
+#define fused_5d(F, F3)  F3(85, sta, zp, 2, 0,  a5, lda, zp, 3, 0)
+#define fused_5e(F, F3)
+#define fused_5f(F, F3)
+#define fused_60(F, F3)
+#define fused_61(F, F3)
+#define fused_62(F, F3)
+#define fused_63(F, F3)
+#define fused_64(F, F3)
+#define fused_65(F, F3)  F3(85, sta, zp, 2, 0,  a5, lda, zp, 3, 0)
+#define fused_66(F, F3)
+#define fused_67(F, F3)
+#define fused_68(F, F3)
+#define fused_69(F, F3)
+#define fused_6a(F, F3)
+#define fused_6b(F, F3)
+#define fused_6c(F, F3)
+#define fused_6d(F, F3)
+#define fused_6e(F, F3)
+#define fused_6f(F, F3)
+#define fused_70(F, F3)
+#define fused_71(F, F3)
+#define fused_72(F, F3)
+#define fused_73(F, F3)
+#define fused_74(F, F3)
+#define fused_75(F, F3)
+#define fused_76(F, F3)
+#define fused_77(F, F3)
+#define fused_78(F, F3)
+#define fused_79(F, F3)
+#define fused_7a(F, F3)
+#define fused_7b(F, F3)
+#define fused_7c(F, F3)
+#define fused_7d(F, F3)
+#define fused_7e(F, F3)
+#define fused_7f(F, F3)
+#define fused_80(F, F3)
+#define fused_81(F, F3)
+#define fused_82(F, F3)
+#define fused_83(F, F3)
+#define fused_84(F, F3)
+#define fused_85(F, F3)  F3(a5, lda, zp, 3, 0,  65, adc, zp, 3, 0)  F3(c8, iny, implied, 2, 0,  d0, bne, relative, 2, 0)  F3(bd, lda, absx, 4, 0,  85, sta, zp, 2, 0)
+#define fused_86(F, F3)
+#define fused_87(F, F3)
+#define fused_88(F, F3)
+#define fused_89(F, F3)
+#define fused_8a(F, F3)
+#define fused_8b(F, F3)
+#define fused_8c(F, F3)
+#define fused_8d(F, F3)  F3(ad, lda, abs, 4, 0,  45, eor, zp, 3, 0)
+#define fused_8e(F, F3)
+#define fused_8f(F, F3)
+#define fused_90(F, F3)
+#define fused_91(F, F3)  F3(c8, iny, implied, 2, 0,  d0, bne, relative, 2, 0)
+#define fused_92(F, F3)
+#define fused_93(F, F3)
+#define fused_94(F, F3)
+#define fused_95(F, F3)
+#define fused_96(F, F3)
+#define fused_97(F, F3)
+#define fused_98(F, F3)
+#define fused_99(F, F3)
+#define fused_9a(F, F3)
+#define fused_9b(F, F3)
+#define fused_9c(F, F3)
+#define fused_9d(F, F3)  F3(e8, inx, implied, 2, 0,  d0, bne, relative, 2, 0)
+#define fused_9e(F, F3)
+#define fused_9f(F, F3)
+#define fused_a0(F, F3)
+#define fused_a1(F, F3)
+#define fused_a2(F, F3)
+#define fused_a3(F, F3)
+#define fused_a4(F, F3)
+#define fused_a5(F, F3)  F3(65, adc, zp, 3, 0,  85, sta, zp, 2, 0)  F3(5d, eor, absx, 4, 0,  85, sta, zp, 2, 0)  F(c9, cmp, immediate, 3, 0)
+#define fused_a6(F, F3)
+#define fused_a7(F, F3)
+#define fused_a8(F, F3)
+#define fused_a9(F, F3)
+#define fused_aa(F, F3)  F3(a5, lda, zp, 3, 0,  5d, eor, absx, 4, 0)
+#define fused_ab(F, F3)
+#define fused_ac(F, F3)
+#define fused_ad(F, F3)  F3(45, eor, zp, 3, 0,  85, sta, zp, 2, 0)
+#define fused_ae(F, F3)
+#define fused_af(F, F3)
+#define fused_b0(F, F3)
+#define fused_b1(F, F3)  F3(91, sta, indy, 6, 0,  c8, iny, implied, 2, 0)  F3(45, eor, zp, 3, 0,  aa, tax, implied, 2, 0)
+#define fused_b2(F, F3)
+#define fused_b3(F, F3)
+#define fused_b4(F, F3)
+#define fused_b5(F, F3)
+#define fused_b6(F, F3)
+#define fused_b7(F, F3)
+#define fused_b8(F, F3)
+#define fused_b9(F, F3)  F(20, jsr, abs, 6, 0)
+#define fused_ba(F, F3)
+#define fused_bb(F, F3)
+#define fused_bc(F, F3)
+#define fused_bd(F, F3)  F3(9d, sta, absx, 5, 0,  e8, inx, implied, 2, 0)
+#define fused_be(F, F3)
+#define fused_bf(F, F3)
+#define fused_c0(F, F3)  F(d0, bne, relative, 2, 0)
+#define fused_c1(F, F3)
+#define fused_c2(F, F3)
+#define fused_c3(F, F3)
+#define fused_c4(F, F3)
+#define fused_c5(F, F3)
+#define fused_c6(F, F3)
+#define fused_c7(F, F3)
+#define fused_c8(F, F3)  F(d0, bne, relative, 2, 0)  F3(c0, cpy, immediate, 3, 0,  d0, bne, relative, 2, 0)
+#define fused_c9(F, F3)
+#define fused_ca(F, F3)
+#define fused_cb(F, F3)
+#define fused_cc(F, F3)
+#define fused_cd(F, F3)
+#define fused_ce(F, F3)
+#define fused_cf(F, F3)
+#define fused_d0(F, F3)
+#define fused_d1(F, F3)
+#define fused_d2(F, F3)
+#define fused_d3(F, F3)
+#define fused_d4(F, F3)
+#define fused_d5(F, F3)
+#define fused_d6(F, F3)
+#define fused_d7(F, F3)
+#define fused_d8(F, F3)
+#define fused_d9(F, F3)
+#define fused_da(F, F3)
+#define fused_db(F, F3)
+#define fused_dc(F, F3)
+#define fused_dd(F, F3)
+#define fused_de(F, F3)
+#define fused_df(F, F3)
+#define fused_e0(F, F3)
+#define fused_e1(F, F3)
+#define fused_e2(F, F3)
+#define fused_e3(F, F3)
+#define fused_e4(F, F3)
+#define fused_e5(F, F3)
+#define fused_e6(F, F3)
+#define fused_e7(F, F3)
+#define fused_e8(F, F3)  F(d0, bne, relative, 2, 0)
+#define fused_e9(F, F3)
+#define fused_ea(F, F3)
+#define fused_eb(F, F3)
+#define fused_ec(F, F3)
+#define fused_ed(F, F3)
+#define fused_ee(F, F3)
+#define fused_ef(F, F3)
+#define fused_f0(F, F3)
+#define fused_f1(F, F3)
+#define fused_f2(F, F3)
+#define fused_f3(F, F3)
+#define fused_f4(F, F3)
+#define fused_f5(F, F3)
+#define fused_f6(F, F3)
+#define fused_f7(F, F3)
+#define fused_f8(F, F3)
+#define fused_f9(F, F3)
+#define fused_fa(F, F3)
+#define fused_fb(F, F3)
+#define fused_fc(F, F3)
+#define fused_fd(F, F3)
+#define fused_fe(F, F3)
+#define fused_ff(F, F3)
@@ -0,0 +1,259 @@
+/* lib6502_idle.c -- idle loop detection and fast-forward	-*- C -*- */
+
+/* Programs that wait for an interrupt or for a status byte to change
+ * spend their time in loops such as
+ *
+ *	wait:	LDA $FE4D
+ *		BEQ wait
+ *
+ * An iteration of such a loop that reads only memory, writes nothing,
+ * and ends with the registers exactly as they were at its start will
+ * be repeated, unchanged, until something outside the loop (an event,
+ * or a read callback returning a different value) intervenes.  The run
+ * loop notices this cheaply: each taken backward branch (or JMP) over
+ * at most IDLE_SPAN bytes compares the branch address and registers
+ * with those it saw at the previous one.  Two matching visits, with no
+ * event run and no branch not taken in between, mean that exactly one
+ * iteration separated them.  The body of the loop is then decoded to
+ * check that it has no side effects, and the cycle count is advanced
+ * by as many whole iterations as fit before the next scheduled event.
+ * The result is exactly what executing those iterations would have
+ * produced.
+ *
+ * If the loop reads through a callback (memory-mapped I/O) the library
+ * cannot know whether the value will change, so it skips only with the
+ * agreement of the handler installed with M6502_setIdle.  The handler
+ * is told about every idle loop found and can also use the opportunity
+ * to sleep until something (input, say) arrives.
+ */
+
+#define IDLE_SPAN	16		/* bytes in the longest loop considered */
+#define IDLE_NONE	(~(uint64_t)0)	/* cannot match any key */
+
+struct _M6502_Idle
+{
+  uint64_t	key;		/* branch address and registers at the last visit */
+  uint64_t	cycles;		/* cycle count at the last visit */
+  M6502_Idle	handler;
+};
+
+#define idleKey(FROM, A, X, Y, P, S)							\
+  ( ((uint64_t)(FROM) << 40) | ((uint64_t)(S) << 32) | ((uint64_t)(P) << 24)		\
+    | ((uint64_t)(Y) << 16) | ((uint64_t)(X) << 8) | (uint64_t)(A) )
+
+/* what the body of an idle loop may contain */
+
+enum { idleNone= 0, idleRead, idleRegister, idleBranch, idleJump };
+
+#define idle_lda	idleRead
+#define idle_ldx	idleRead
+#define idle_ldy	idleRead
+#define idle_cmp	idleRead
+#define idle_cpx	idleRead
+#define idle_cpy	idleRead
+#define idle_bit	idleRead
+#define idle_and	idleRead
+#define idle_ora	idleRead
+#define idle_eor	idleRead
+#define idle_adc	idleRead
+#define idle_sbc	idleRead
+#define idle_nop	idleRegister
+#define idle_clc	idleRegister
+#define idle_sec	idleRegister
+#define idle_cli	idleRegister
+#define idle_sei	idleRegister
+#define idle_clv	idleRegister
+#define idle_cld	idleRegister
+#define idle_sed	idleRegister
+#define idle_tax	idleRegister
+#define idle_tay	idleRegister
+#define idle_txa	idleRegister
+#define idle_tya	idleRegister
+#define idle_tsx	idleRegister
+#define idle_txs	idleRegister
+#define idle_inx	idleRegister
+#define idle_iny	idleRegister
+#define idle_dex	idleRegister
+#define idle_dey	idleRegister
+#define idle_ina	idleRegister
+#define idle_dea	idleRegister
+#define idle_asla	idleRegister
+#define idle_lsra	idleRegister
+#define idle_rola	idleRegister
+#define idle_rora	idleRegister
+#define idle_bcc	idleBranch
+#define idle_bcs	idleBranch
+#define idle_beq	idleBranch
+#define idle_bne	idleBranch
+#define idle_bmi	idleBranch
+#define idle_bpl	idleBranch
+#define idle_bvc	idleBranch
+#define idle_bvs	idleBranch
+#define idle_bra	idleBranch
+#define idle_jmp	idleJump
+#define idle_asl	idleNone
+#define idle_lsr	idleNone
+#define idle_rol	idleNone
+#define idle_ror	idleNone
+#define idle_inc	idleNone
+#define idle_dec	idleNone
+#define idle_sta	idleNone
+#define idle_stx	idleNone
+#define idle_sty	idleNone
+#define idle_stz	idleNone
+#define idle_tsb	idleNone
+#define idle_trb	idleNone
+#define idle_pha	idleNone
+#define idle_php	idleNone
+#define idle_phx	idleNone
+#define idle_phy	idleNone
+#define idle_pla	idleNone
+#define idle_plp	idleNone
+#define idle_plx	idleNone
+#define idle_ply	idleNone
+#define idle_jsr	idleNone
+#define idle_rts	idleNone
+#define idle_rti	idleNone
+#define idle_brk	idleNone
+#define idle_ill	idleNone
+
+enum { modeImplied, modeImmediate, modeZp, modeZpx, modeZpy, modeAbs, modeAbsx, modeAbsy,
+       modeIndx, modeIndy, modeIndzp, modeRelative, modeOther };
+
+#define idle_implied	modeImplied
+#define idle_immediate	modeImmediate
+#define idle_zp		modeZp
+#define idle_zpx	modeZpx
+#define idle_zpy	modeZpy
+#define idle_abs	modeAbs
+#define idle_absx	modeAbsx
+#define idle_absy	modeAbsy
+#define idle_indx	modeIndx
+#define idle_indy	modeIndy
+#define idle_indzp	modeIndzp
+#define idle_relative	modeRelative
+#define idle_indirect	modeOther
+#define idle_indabsx	modeOther
+
+static byte idleKind[2][256];	/* [model][opcode] */
+static byte idleMode[256];
+
+static void idleBuild(void)
+{
+# define idleOp(num, name, mode, cycles)	idleKind[M6502_NMOS][0x##num]= idleKind[M6502_CMOS][0x##num]= idle_##name;  idleMode[0x##num]= idle_##mode
+# define idleCmos(num, name, mode, cycles)	idleKind[M6502_CMOS][0x##num]= idle_##name;  idleMode[0x##num]= idle_##mode
+  do_insns(idleOp, idleCmos);
+# undef idleOp
+# undef idleCmos
+}
+
+static void idleInit(void)
+{
+  static pthread_once_t once= PTHREAD_ONCE_INIT;	/* see dumpInit() */
+  pthread_once(&once, idleBuild);
+}
+
+
+/* decode the loop from its first instruction at pc to the branch or
+ * jump at from.  answers -1 if it has side effects, otherwise whether
+ * any operand is read through a callback.
+ */
+
+static int idleDecode(M6502 *mpu, word pc, word from)
+{
+  byte *memory= mpu->memory;
+  byte  x= mpu->registers->x, y= mpu->registers->y;
+  byte	kind;
+  int	io= 0;
+
+  for (;;)
+    {
+      byte op= memory[pc], tmp;
+      word ea;
+      if (!(kind= idleKind[mpu->model][op]))
+	return -1;
+      switch (idleMode[op])
+	{
+	case modeImplied:	ea= 0;  break;
+	case modeImmediate:	ea= pc + 1;  break;
+	case modeZp:		ea= memory[(word)(pc + 1)];  break;
+	case modeZpx:		ea= (byte)(memory[(word)(pc + 1)] + x);  break;
+	case modeZpy:		ea= (byte)(memory[(word)(pc + 1)] + y);  break;
+	case modeAbs:		ea= memory[(word)(pc + 1)] + (memory[(word)(pc + 2)] << 8);  break;
+	case modeAbsx:		ea= memory[(word)(pc + 1)] + (memory[(word)(pc + 2)] << 8) + x;  break;
+	case modeAbsy:		ea= memory[(word)(pc + 1)] + (memory[(word)(pc + 2)] << 8) + y;  break;
+	case modeIndx:		tmp= memory[(word)(pc + 1)] + x;  ea= memory[tmp] + (memory[tmp + 1] << 8);  break;
+	case modeIndy:		tmp= memory[(word)(pc + 1)];  ea= memory[tmp] + (memory[tmp + 1] << 8) + y;  break;
+	case modeIndzp:		tmp= memory[(word)(pc + 1)];  ea= memory[tmp] + (memory[tmp + 1] << 8);  break;
+	case modeRelative:	ea= 0;  break;
+	default:		return -1;
+	}
+      if (pc == from)
+	return (((idleBranch == kind) && (modeRelative == idleMode[op]))
+		|| ((idleJump == kind) && (modeAbs == idleMode[op]) && !mpu->callbacks->call[ea]))
+	  ? io : -1;
+      if (idleRead == kind)
+	io |= (modeImmediate != idleMode[op]) && mpu->callbacks->read[ea];
+      else if (idleRegister != kind)
+	return -1;
+      switch (idleMode[op])
+	{
+	case modeImplied:	pc += 1;  break;
+	case modeAbs:
+	case modeAbsx:
+	case modeAbsy:		pc += 3;  break;
+	default:		pc += 2;  break;
+	}
+      if ((word)(from - pc) > IDLE_SPAN)	/* ran past the branch */
+	return -1;
+    }
+}
+
+
+/* called by the run loop (with the registers externalised, and pc at
+ * the start of the loop) when the branch or jump at from has been taken
+ * twice in succession with identical registers.  advances mpu->cycles
+ * by the iterations that can be skipped.
+ */
+
+static void idleFound(M6502 *mpu, word from)
+{
+  struct _M6502_Idle *idle= mpu->idle;
+  uint64_t period= mpu->cycles - idle->cycles;
+  uint64_t until;
+  int	   io;
+
+  idle->cycles= mpu->cycles;
+  if ((mpu->flags & (M6502_TraceExecution | M6502_SingleStep))
+      || ((io= idleDecode(mpu, mpu->registers->pc, from)) < 0))
+    return;
+  if (idle->handler ? !idle->handler(mpu, eventsDeadline(mpu), io) : io)
+    return;
+  until= eventsDeadline(mpu);	/* the handler may have scheduled something */
+  if ((NEVER != until) && (until > mpu->cycles + period))
+    {
+      mpu->cycles += (until - 1 - mpu->cycles) / period * period;
+      idle->cycles= mpu->cycles;
+    }
+}
+
+
+static void idleNew(M6502 *mpu)
+{
+  idleInit();
+  if (!(mpu->idle= calloc(1, sizeof(struct _M6502_Idle)))) outOfMemory();
+  mpu->idle->key= IDLE_NONE;
+}
+
+
+static void idleDelete(M6502 *mpu)
+{
+  free(mpu->idle);
+  mpu->idle= 0;
+}
+
+
+void M6502_setIdle(M6502 *mpu, M6502_Idle handler)
+{
+  mpu->idle->handler= handler;
+}
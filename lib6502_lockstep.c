@@ -0,0 +1,305 @@
+/* lib6502_lockstep.c -- differential execution of two instances	-*- C -*- */
+
+/* Two instances (normally identical but for the engine that runs
+ * them) are run side by side.  The reference is always stepped one
+ * instruction at a time.  The candidate is either stepped in the same
+ * way (M6502_LockstepStep) or runs its own engine, superinstructions
+ * and idle fast-forward included, returning after every dispatch
+ * (M6502_LockstepRun); the reference is then stepped until its cycle
+ * count catches up.  After each step their registers, cycle counts
+ * and stacks are compared, and every memory access made by one is
+ * checked against the corresponding access made by the other.
+ *
+ * Client callbacks run only in the instance that goes first in each
+ * step (the leader: the reference when stepping, the candidate when it
+ * runs its engine).  Their results are replayed into the other (the
+ * follower): read callbacks return the value the leader saw, call
+ * callbacks return the leader's address and leave the follower with
+ * the leader's registers, and after any step in which a client
+ * callback ran the leader's memory is copied into the follower.  The
+ * follower therefore never duplicates side effects (I/O) and never
+ * sees different input.  While the candidate leads, idle loops that
+ * read through a callback are not skipped, since the reference would
+ * make the reads that were skipped.
+ */
+
+#include <stdarg.h>
+#include <string.h>
+
+#define LOCKSTEP_HISTORY	16	/* instructions shown before a divergence */
+#define LOCKSTEP_EVENTS		64	/* callbacks per instruction (plenty) */
+
+typedef struct
+{
+  char		  kind;		/* 'r'ead, 'w'rite or 'c'all */
+  word		  addr;
+  byte		  data;
+  int		  result;	/* value returned by the client callback */
+  M6502_Registers before;	/* call: state on entry to the callback */
+  M6502_Registers after;	/* call: state on return from the callback */
+} LockstepEvent;
+
+static struct
+{
+  M6502		  *lead, *follow;
+  const char	  *leadName, *followName;
+  M6502_Callbacks *saved[2];	/* client callbacks of lead and follow */
+  M6502_Idle	   idle;	/* client idle handler of cand */
+  LockstepEvent	   events[LOCKSTEP_EVENTS];
+  int		   nevents;	/* recorded by lead during this step */
+  int		   next;	/* consumed by follow during this step */
+  int		   foreign;	/* a client callback ran in lead */
+  char		   diverged[128];
+} lockstep;
+
+
+static void lockstepDiverged(const char *fmt, ...)
+{
+  va_list ap;
+  if (lockstep.diverged[0])
+    return;
+  va_start(ap, fmt);
+  vsnprintf(lockstep.diverged, sizeof(lockstep.diverged), fmt, ap);
+  va_end(ap);
+}
+
+
+static int lockstepSame(M6502_Registers *r, M6502_Registers *s)
+{
+  return r->a == s->a && r->x == s->x && r->y == s->y && r->p == s->p && r->s == s->s && r->pc == s->pc;
+}
+
+
+static LockstepEvent *lockstepRecord(char kind, word addr, byte data)
+{
+  LockstepEvent *e= lockstep.events + lockstep.nevents;
+  if (lockstep.nevents == LOCKSTEP_EVENTS)
+    {
+      lockstepDiverged("more than %d callbacks in one step", LOCKSTEP_EVENTS);
+      return lockstep.events;
+    }
+  ++lockstep.nevents;
+  e->kind= kind;
+  e->addr= addr;
+  e->data= data;
+  return e;
+}
+
+
+static LockstepEvent *lockstepReplay(char kind, word addr, byte data)
+{
+  static LockstepEvent none;
+  LockstepEvent *e;
+  if (lockstep.next == lockstep.nevents)
+    {
+      lockstepDiverged("%s made an extra access to %04X (%c)", lockstep.followName, addr, kind);
+      return &none;
+    }
+  e= lockstep.events + lockstep.next++;
+  if (e->kind != kind || e->addr != addr)
+    lockstepDiverged("%s accessed %04X (%c), %s accessed %04X",
+		     lockstep.followName, addr, kind, lockstep.leadName, e->addr);
+  else if ('w' == kind && e->data != data)
+    lockstepDiverged("%s wrote %02X to %04X, %s wrote %02X",
+		     lockstep.followName, data, addr, lockstep.leadName, e->data);
+  return e;
+}
+
+
+static int lockstepRead(M6502 *mpu, word addr, byte data)
+{
+  if (mpu == lockstep.lead)
+    {
+      M6502_Callback cb= lockstep.saved[0]->read[addr];
+      LockstepEvent *e= lockstepRecord('r', addr, data);
+      lockstep.foreign= 1;
+      return e->result= cb(mpu, addr, data);
+    }
+  return lockstepReplay('r', addr, data)->result;
+}
+
+
+static int lockstepWrite(M6502 *mpu, word addr, byte data)
+{
+  if (mpu == lockstep.lead)
+    {
+      M6502_Callback cb= lockstep.saved[0]->write[addr];
+      LockstepEvent *e= lockstepRecord('w', addr, data);
+      if (!cb)
+	return mpu->memory[addr]= data;
+      lockstep.foreign= 1;
+      return e->result= cb(mpu, addr, data);
+    }
+  lockstepReplay('w', addr, data);
+  if (!lockstep.saved[1]->write[addr])
+    mpu->memory[addr]= data;
+  return data;
+}
+
+
+static int lockstepCall(M6502 *mpu, word addr, byte data)
+{
+  LockstepEvent *e;
+  if (mpu == lockstep.lead)
+    {
+      M6502_Callback cb= lockstep.saved[0]->call[addr];
+      word	     hdlr= addr;
+      if (!cb)	/* BRK passes the address of the BRK, not of the handler */
+	cb= lockstep.saved[0]->call[hdlr= M6502_getVector(mpu, IRQ)];
+      e= lockstepRecord('c', addr, data);
+      e->before= *mpu->registers;
+      lockstep.foreign= 1;
+      if ((trapCall == cb) && (hdlr != addr))	/* a trap entered by BRK */
+	e->result= trapBreak(mpu, hdlr, 0);
+      else
+	e->result= cb(mpu, addr, data);
+      e->after= *mpu->registers;
+      return e->result;
+    }
+  e= lockstepReplay('c', addr, data);
+  if (!lockstepSame(&e->before, mpu->registers))
+    lockstepDiverged("registers differ on entry to callback at %04X", addr);
+  *mpu->registers= e->after;
+  return e->result;
+}
+
+
+static void lockstepInstall(M6502 *mpu, M6502_Callbacks *saved)
+{
+  unsigned addr;
+  memcpy(saved, mpu->callbacks, sizeof(M6502_Callbacks));
+  for (addr= 0;  addr < 0x10000;  ++addr)
+    {
+      if (saved->read[addr])  mpu->callbacks->read[addr]= lockstepRead;
+      if (saved->call[addr])  mpu->callbacks->call[addr]= lockstepCall;
+      mpu->callbacks->write[addr]= lockstepWrite;
+    }
+}
+
+
+/* the candidate's idle handler while it leads: loops that read through
+ * a callback must run in full (see above) */
+
+static int lockstepIdle(M6502 *mpu, uint64_t until, int io)
+{
+  if (io)
+    return 0;
+  return lockstep.idle ? lockstep.idle(mpu, until, io) : 1;
+}
+
+
+static void lockstepReport(FILE *stream, unsigned long count, word history[], M6502 *ref, M6502 *cand)
+{
+  char state[64], insn[64];
+  unsigned long i= (count > LOCKSTEP_HISTORY) ? count - LOCKSTEP_HISTORY : 0;
+
+  fflush(stdout);
+  fprintf(stream, "\nlockstep: divergence at instruction %lu: %s\n", count, lockstep.diverged);
+  for (;  i < count;  ++i)
+    {
+      word pc= history[i % LOCKSTEP_HISTORY];
+      M6502_disassemble(ref, pc, insn);
+      fprintf(stream, "%s %04X %s\n", (i == count - 1) ? "=>" : "  ", pc, insn);
+    }
+  M6502_dump(ref, state);
+  M6502_disassemble(ref, ref->registers->pc, insn);
+  fprintf(stream, "reference: %s  %s\n", state, insn);
+  M6502_dump(cand, state);
+  M6502_disassemble(cand, cand->registers->pc, insn);
+  fprintf(stream, "candidate: %s  %s\n", state, insn);
+}
+
+
+/* run reference and candidate in lockstep, the candidate as engine
+ * says (see above), for at most limit instructions of the reference
+ * (zero meaning no limit) or until both stop on an undefined
+ * instruction.  answers zero if no divergence was found, otherwise the
+ * (1-based) number of the reference instruction at which it was found,
+ * a description of which is written on report (if non-NULL).
+ */
+
+unsigned long M6502_lockstep(M6502 *ref, M6502 *cand, int engine, unsigned long limit, FILE *report)
+{
+  word		  history[LOCKSTEP_HISTORY];
+  unsigned long	  count= 0, diverged= 0;
+  M6502_Callbacks *saved[2];
+  int		  run= (M6502_LockstepRun == engine);
+
+  if (!(saved[0]= malloc(sizeof(M6502_Callbacks))) || !(saved[1]= malloc(sizeof(M6502_Callbacks))))
+    outOfMemory();
+
+  lockstep.lead=       run ? cand : ref;
+  lockstep.follow=     run ? ref  : cand;
+  lockstep.leadName=   run ? "candidate" : "reference";
+  lockstep.followName= run ? "reference" : "candidate";
+  lockstep.saved[0]= saved[0];
+  lockstep.saved[1]= saved[1];
+  lockstepInstall(lockstep.lead,   saved[0]);
+  lockstepInstall(lockstep.follow, saved[1]);
+  lockstep.idle= cand->idle->handler;
+  if (run)
+    {
+      cand->idle->handler= lockstepIdle;
+      cand->flags |= M6502_StepDispatch;
+    }
+
+  while (!limit || count < limit)
+    {
+      int refOk, candOk;
+
+      lockstep.nevents= lockstep.next= lockstep.foreign= 0;
+      lockstep.diverged[0]= '\0';
+
+      if (run)
+	{
+	  uint64_t start= cand->cycles;
+	  M6502_run(cand);
+	  candOk= (cand->cycles != start);	/* every instruction but an undefined one takes time */
+	  do
+	    {
+	      history[count++ % LOCKSTEP_HISTORY]= ref->registers->pc;
+	      refOk= M6502_step(ref);
+	    }
+	  while (refOk && candOk && (ref->cycles < cand->cycles));
+	}
+      else
+	{
+	  history[count++ % LOCKSTEP_HISTORY]= ref->registers->pc;
+	  refOk=  M6502_step(ref);
+	  candOk= M6502_step(cand);
+	}
+
+      if (refOk != candOk)
+	lockstepDiverged("only the %s stopped on an undefined instruction", refOk ? "candidate" : "reference");
+      else if (lockstep.next != lockstep.nevents)
+	lockstepDiverged("%s made %d fewer memory accesses", lockstep.followName, lockstep.nevents - lockstep.next);
+      else if (!lockstepSame(ref->registers, cand->registers))
+	lockstepDiverged("registers differ");
+      else if (ref->cycles != cand->cycles)
+	lockstepDiverged("cycle counts differ");
+      else if (memcmp(ref->memory + 0x0100, cand->memory + 0x0100, 0x0100))
+	lockstepDiverged("stack contents differ");
+
+      if (lockstep.diverged[0])
+	{
+	  if (report)
+	    lockstepReport(report, count, history, ref, cand);
+	  diverged= count;
+	  break;
+	}
+      if (lockstep.foreign)
+	memcpy(lockstep.follow->memory, lockstep.lead->memory, 0x10000);
+      if (!refOk)
+	break;
+    }
+
+  cand->flags &= ~M6502_StepDispatch;
+  cand->idle->handler= lockstep.idle;
+  memcpy(lockstep.lead->callbacks,   saved[0], sizeof(M6502_Callbacks));
+  memcpy(lockstep.follow->callbacks, saved[1], sizeof(M6502_Callbacks));
+  free(saved[0]);
+  free(saved[1]);
+  lockstep.lead= lockstep.follow= 0;
+
+  return diverged;
+}
@@ -0,0 +1,196 @@
+/* lib6502_rom.c -- shared read-only memory			-*- C -*- */
+
+/* An M6502_ROM holds its contents in a file that is mapped, rather than
+ * copied, into the memory of any number of instances.  The mappings
+ * are private (copy on write), so each instance behaves exactly as if
+ * the contents had been copied: a page it writes becomes its own.
+ * Until then every instance that maps the ROM shares one physical
+ * copy of its pages with all the others, and its resident memory is
+ * only the pages it has written.
+ *
+ * ROMs are found by their contents.  Each process keeps a pool of the
+ * ROMs it has made, and M6502_newROM answers one that is already there
+ * when the bytes are the same.  Given a pool directory the file is
+ * named there after the hash of the contents (and the owner, whose
+ * files alone are trusted), so other processes making the same ROM
+ * open the same file and share the same pages; files are created under
+ * a temporary name and renamed, and checked against the contents
+ * before they are used, so processes can race to make the same ROM.
+ * Without a directory the file is unlinked as soon as it is made.
+ *
+ * Only whole host pages of memory allocated by the library can be
+ * mapped; anything else (the end of a ROM that is not a multiple of
+ * the page size, a ROM at an address that is not on a page boundary,
+ * memory provided by the client) is copied, as it would be without a
+ * ROM at all.  A ROM smaller than a page is never given a file.
+ */
+
+/* the system headers are included by lib6502.c */
+
+static M6502_ROM *romPool= 0;
+
+
+static uint64_t romHash(const uint8_t *data, size_t length)
+{
+  uint64_t hash= 0xCBF29CE484222325ULL;		/* FNV-1a */
+  while (length--)
+    hash= (hash ^ *data++) * 0x100000001B3ULL;
+  return hash;
+}
+
+
+static size_t romPages(size_t length)
+{
+  size_t page= sysconf(_SC_PAGESIZE);
+  return (length + page - 1) / page * page;
+}
+
+
+/* map the file, if it holds exactly the contents */
+
+static int romOpen(M6502_ROM *rom, int fd, const uint8_t *data)
+{
+  size_t size= romPages(rom->length);
+  struct stat st;
+  void	     *map;
+
+  if (fstat(fd, &st) || (st.st_uid != geteuid()) || ((size_t)st.st_size != size)
+      || (MAP_FAILED == (map= mmap(0, size, PROT_READ, MAP_SHARED, fd, 0))))
+    return 0;
+  if (memcmp(map, data, rom->length))
+    {
+      munmap(map, size);
+      return 0;
+    }
+  rom->data= map;
+  rom->fd= fd;
+  return 1;
+}
+
+
+/* write the contents to a new file in dir, and name it path if given */
+
+static int romCreate(M6502_ROM *rom, const char *dir, const char *path, const uint8_t *data)
+{
+  size_t size= romPages(rom->length);
+  char	 temp[1024];
+  int	 fd;
+
+  snprintf(temp, sizeof(temp), "%s/lib6502-XXXXXX", dir);
+  if ((fd= mkstemp(temp)) < 0)
+    return 0;
+  if (path ? fchmod(fd, 0644) : unlink(temp))
+    goto fail;
+  if ((write(fd, data, rom->length) != (ssize_t)rom->length) || ftruncate(fd, size))
+    goto fail;
+  if (path && rename(temp, path))
+    goto fail;
+  if (romOpen(rom, fd, data))
+    return 1;
+ fail:
+  if (path) unlink(temp);
+  close(fd);
+  return 0;
+}
+
+
+M6502_ROM *M6502_newROM(const uint8_t *data, size_t length, const char *pool)
+{
+  uint64_t   hash= romHash(data, length);
+  M6502_ROM *rom;
+  char	     path[1024];
+  int	     fd;
+
+  for (rom= romPool;  rom;  rom= rom->next)
+    if ((rom->hash == hash) && (rom->length == length) && !memcmp(rom->data, data, length))
+      {
+	++rom->refs;
+	return rom;
+      }
+
+  if (!(rom= calloc(1, sizeof(M6502_ROM)))) outOfMemory();
+  rom->length= length;
+  rom->hash= hash;
+  rom->refs= 1;
+  rom->fd= -1;
+  if (length < (size_t)sysconf(_SC_PAGESIZE))
+    ;				/* too small to be mapped */
+  else if (pool)
+    {
+      snprintf(path, sizeof(path), "%s/lib6502-%lu-%016llx-%lx", pool,
+	       (unsigned long)geteuid(), (unsigned long long)hash, (unsigned long)length);
+      if ((fd= open(path, O_RDONLY)) >= 0 && !romOpen(rom, fd, data))
+	close(fd);
+      if (rom->fd < 0)
+	romCreate(rom, pool, path, data);
+    }
+  else
+    romCreate(rom, P_tmpdir, 0, data);
+  if (rom->fd < 0)		/* not shared, but still correct */
+    {
+      uint8_t *copy= malloc(length ? length : 1);
+      if (!copy) outOfMemory();
+      memcpy(copy, data, length);
+      rom->data= copy;
+    }
+  rom->next= romPool;
+  romPool= rom;
+  return rom;
+}
+
+
+void M6502_mapROM(M6502 *mpu, uint16_t address, M6502_ROM *rom)
+{
+  size_t length= rom->length, mapped= 0, page= sysconf(_SC_PAGESIZE);
+
+  if (length > 0x10000 - (size_t)address)
+    length= 0x10000 - address;
+  if (!length)
+    return;
+  if ((rom->fd >= 0) && (mpu->flags & M6502_MemoryAllocated)
+      && !((uintptr_t)(mpu->memory + address) % page))
+    {
+      mapped= length / page * page;			/* whole pages only */
+      if (mapped && (MAP_FAILED == mmap(mpu->memory + address, mapped, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_FIXED, rom->fd, 0)))
+	{
+	  /* the old pages may be gone: put fresh ones there to copy into */
+	  if (MAP_FAILED == mmap(mpu->memory + address, mapped, PROT_READ | PROT_WRITE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0))
+	    outOfMemory();
+	  mapped= 0;
+	}
+    }
+  memcpy(mpu->memory + address + mapped, rom->data + mapped, length - mapped);
+  M6502_touch(mpu, address, address + length - 1);
+}
+
+
+void M6502_deleteROM(M6502_ROM *rom)
+{
+  M6502_ROM **prev;
+
+  if (--rom->refs)
+    return;
+  for (prev= &romPool;  *prev != rom;  prev= &(*prev)->next)
+    ;
+  *prev= rom->next;
+  if (rom->fd >= 0)
+    {
+      munmap((void *)rom->data, romPages(rom->length));
+      close(rom->fd);	/* instances that mapped it keep their pages */
+    }
+  else
+    free((void *)rom->data);
+  free(rom);
+}
+
+
+/* memory allocated by the library is mapped, so that ROMs can be
+ * mapped over it */
+
+static uint8_t *romMemory(void)
+{
+  void *memory= mmap(0, sizeof(M6502_Memory), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return (MAP_FAILED == memory) ? 0 : memory;
+}
@@ -0,0 +1,207 @@
+/* lib6502_run.c -- instruction dispatch for one processor model	-*- C -*- */
+
+/* Included once per model by lib6502_main.c with RUN defined as the
+ * name of the function to generate, CMOS defined as 1 (65C02) or 0
+ * (NMOS 6502), and DEBUG defined as 1 for the engine that checks
+ * breakpoints and watchpoints (see lib6502_debug.c) and keeps the
+ * performance counters, coverage and heatmap (see lib6502_counters.c)
+ * or 0.  Instructions in
+ * the second column of do_insns are dispatched only for the 65C02;
+ * the NMOS engine decodes them as undefined.  Everything else that
+ * differs between the models is selected inside the instruction macros
+ * by testing CMOS, which the compiler folds away, so neither engine
+ * contains a run-time model check.
+ *
+ * Unless M6502_FUSED is 0 the normal engines also contain the
+ * superinstructions listed in lib6502_fused.h: after an instruction
+ * that is often followed by a particular second (and third) one, the
+ * handler checks for it and, if nothing is due at this instruction
+ * boundary (no event, single step or trace), retires the first and
+ * executes the second without going back through the dispatch.  The
+ * effect is identical to executing them separately.
+ */
+
+static void RUN(M6502 *mpu)
+{
+	unsigned char buffer[84];
+	
+//#if defined(__GNUC__) && !defined(__STRICT_ANSI__)
+#if 0
+
+  static void *itab[256]= { &&_00, &&_01, &&_02, &&_03, &&_04, &&_05, &&_06, &&_07, &&_08, &&_09, &&_0a, &&_0b, &&_0c, &&_0d, &&_0e, &&_0f,
+			    &&_10, &&_11, &&_12, &&_13, &&_14, &&_15, &&_16, &&_17, &&_18, &&_19, &&_1a, &&_1b, &&_1c, &&_1d, &&_1e, &&_1f,
+			    &&_20, &&_21, &&_22, &&_23, &&_24, &&_25, &&_26, &&_27, &&_28, &&_29, &&_2a, &&_2b, &&_2c, &&_2d, &&_2e, &&_2f,
+			    &&_30, &&_31, &&_32, &&_33, &&_34, &&_35, &&_36, &&_37, &&_38, &&_39, &&_3a, &&_3b, &&_3c, &&_3d, &&_3e, &&_3f,
+			    &&_40, &&_41, &&_42, &&_43, &&_44, &&_45, &&_46, &&_47, &&_48, &&_49, &&_4a, &&_4b, &&_4c, &&_4d, &&_4e, &&_4f,
+			    &&_50, &&_51, &&_52, &&_53, &&_54, &&_55, &&_56, &&_57, &&_58, &&_59, &&_5a, &&_5b, &&_5c, &&_5d, &&_5e, &&_5f,
+			    &&_60, &&_61, &&_62, &&_63, &&_64, &&_65, &&_66, &&_67, &&_68, &&_69, &&_6a, &&_6b, &&_6c, &&_6d, &&_6e, &&_6f,
+			    &&_70, &&_71, &&_72, &&_73, &&_74, &&_75, &&_76, &&_77, &&_78, &&_79, &&_7a, &&_7b, &&_7c, &&_7d, &&_7e, &&_7f,
+			    &&_80, &&_81, &&_82, &&_83, &&_84, &&_85, &&_86, &&_87, &&_88, &&_89, &&_8a, &&_8b, &&_8c, &&_8d, &&_8e, &&_8f,
+			    &&_90, &&_91, &&_92, &&_93, &&_94, &&_95, &&_96, &&_97, &&_98, &&_99, &&_9a, &&_9b, &&_9c, &&_9d, &&_9e, &&_9f,
+			    &&_a0, &&_a1, &&_a2, &&_a3, &&_a4, &&_a5, &&_a6, &&_a7, &&_a8, &&_a9, &&_aa, &&_ab, &&_ac, &&_ad, &&_ae, &&_af,
+			    &&_b0, &&_b1, &&_b2, &&_b3, &&_b4, &&_b5, &&_b6, &&_b7, &&_b8, &&_b9, &&_ba, &&_bb, &&_bc, &&_bd, &&_be, &&_bf,
+			    &&_c0, &&_c1, &&_c2, &&_c3, &&_c4, &&_c5, &&_c6, &&_c7, &&_c8, &&_c9, &&_ca, &&_cb, &&_cc, &&_cd, &&_ce, &&_cf,
+			    &&_d0, &&_d1, &&_d2, &&_d3, &&_d4, &&_d5, &&_d6, &&_d7, &&_d8, &&_d9, &&_da, &&_db, &&_dc, &&_dd, &&_de, &&_df,
+			    &&_e0, &&_e1, &&_e2, &&_e3, &&_e4, &&_e5, &&_e6, &&_e7, &&_e8, &&_e9, &&_ea, &&_eb, &&_ec, &&_ed, &&_ee, &&_ef,
+			    &&_f0, &&_f1, &&_f2, &&_f3, &&_f4, &&_f5, &&_f6, &&_f7, &&_f8, &&_f9, &&_fa, &&_fb, &&_fc, &&_fd, &&_fe, &&_ff };
+
+  register void **itabp= &itab[0];
+  register void  *tpc;
+
+# define begin()				fetch();  next()
+# define fetch()				tpc= itabp[memory[PC++]]
+# define next()					goto *tpc
+# define dispatch(num, name, mode, cycles)	_##num: name(cycles, mode) oops();  next()
+# define undefined(num, name, mode, cycles)	_##num: ill(cycles, implied) oops();  next()
+# define end()
+# define end2()
+
+#else /* (!__GNUC__) || (__STRICT_ANSI__) */
+
+/* the DEBUG engine records coverage and heatmap executions when the
+ * opcode is fetched: an instruction that never completes (a JMP to a
+ * trap that exits, say) has still been executed */
+# define fetched()	insn= memory[here= PC++];							\
+			if (mpu->coverage) mpu->coverage[here >> 3] |= 1 << (here & 7);		\
+			if (mpu->heatmap)  ++mpu->heatmap->executes[here]
+# define begin()				for (;;) { if (DEBUG) { fetched(); }  switch (DEBUG ? insn : memory[PC++]) {
+# define fetch()
+# define next()					break
+#if M6502_FUSED
+# define dispatch(num, name, mode, cycles)	case 0x##num: do { name(cycles, mode); } while (0);  fused_##num(fuse, fuse3)  next()
+#else
+# define dispatch(num, name, mode, cycles)	case 0x##num: name(cycles, mode);  next()
+#endif
+# define undefined(num, name, mode, cycles)	case 0x##num: ill(cycles, implied);  next()
+# define end()					}
+# define end2()					}
+
+#endif
+
+  register byte  *memory= mpu->memory;
+  register word   PC;
+  word		  ea;
+  byte		  A, X, Y, P, S;
+  uint64_t	  cycles;
+  byte		  insn= 0;	/* the opcode being executed (DEBUG only) */
+  word		  here= 0;	/* and its address */
+  byte		 *debugPages= DEBUG ? mpu->debug->pages : 0;
+  byte		 *dirty= mpu->checkpoints->dirty;
+  struct _M6502_Idle *idle= mpu->idle;
+  M6502_Callback *readCallback=  mpu->callbacks->read;
+  M6502_Callback *writeCallback= mpu->callbacks->write;
+
+# define fusable(num, cmos)							\
+  ((CMOS || !cmos) && !DEBUG && (memory[PC] == 0x##num)				\
+   && (cycles < eventsDeadline(mpu))						\
+   && !(mpu->flags & (M6502_SingleStep | M6502_TraceExecution)))
+
+# define fuse(num, name, mode, ticks, cmos)		\
+  if (fusable(num, cmos))				\
+    {							\
+      retire();						\
+      PC++;						\
+      do { name(ticks, mode); } while (0);		\
+      next();						\
+    }
+
+# define fuse3(num, name, mode, ticks, cmos, num3, name3, mode3, ticks3, cmos3)	\
+  if (fusable(num, cmos))				\
+    {							\
+      retire();						\
+      PC++;						\
+      do { name(ticks, mode); } while (0);		\
+      if (fusable(num3, cmos3))				\
+	{						\
+	  retire();					\
+	  PC++;						\
+	  do { name3(ticks3, mode3); } while (0);	\
+	}						\
+      next();						\
+    }
+
+# define internalise()	A= mpu->registers->a;  X= mpu->registers->x;  Y= mpu->registers->y;  P= mpu->registers->p;  S= mpu->registers->s;  PC= mpu->registers->pc;  cycles= mpu->cycles
+# define externalise()	mpu->registers->a= A;  mpu->registers->x= X;  mpu->registers->y= Y;  mpu->registers->p= P;  mpu->registers->s= S;  mpu->registers->pc= PC;  mpu->cycles= cycles
+# define retire()	externalise();  M6502_log(mpu);  loops++
+# define halt()		return
+
+  internalise();
+  idle->key= IDLE_NONE;		/* memory may have changed since the last run */
+  unmask();			/* and so may P */
+
+  if (DEBUG && debugEnter(mpu))
+    return;
+
+  begin();
+#if CMOS
+  do_insns(dispatch, dispatch);
+#else
+  do_insns(dispatch, undefined);
+#endif
+  end();
+#if 1
+
+  if (DEBUG && mpu->counting)
+    ++mpu->counting->counters.opcodes[insn];
+
+  externalise();
+  M6502_log(mpu);
+  
+  if(mpu->flags&M6502_TraceExecution)
+  {
+//  externalise();
+//  M6502_dump(mpu,buffer);
+//  printf(";%s: ",buffer);
+//  M6502_disassemble(mpu,mpu->registers->pc,buffer);
+//  printf("%s\n",buffer);
+    M6502_log_printlast();
+  }
+  	loops++;
+	if(loops>100000000)
+	{
+		fprintf(stderr,"[ABORT!]\n");
+		exit(0);
+	}
+
+  if (cycles >= eventsDeadline(mpu))
+    {
+      eventsRun(mpu);
+      internalise();
+      idle->key= IDLE_NONE;
+    }
+
+  if (DEBUG && ((mpu->debug->nhits && debugWatched(mpu))
+		|| ((debugPages[PC >> 8] & M6502_Break) && debugBreak(mpu, PC))))
+    {
+      mpu->flags &= ~M6502_SingleStep;
+      return;
+    }
+
+  if (mpu->flags & (M6502_SingleStep | M6502_StepDispatch))
+    {
+      mpu->flags &= ~M6502_SingleStep;
+      return;
+    }
+#endif
+  end2();
+
+# undef fetched
+# undef begin
+# undef internalise
+# undef externalise
+# undef retire
+# undef halt
+# undef fusable
+# undef fuse
+# undef fuse3
+# undef fetch
+# undef next
+# undef dispatch
+# undef undefined
+# undef end
+# undef end2
+
+  (void)oops;
+  (void)insn;
+  (void)here;
+}
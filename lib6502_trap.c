@@ -0,0 +1,106 @@
+/* lib6502_trap.c -- native subroutines				-*- C -*- */
+
+/* A trap is a call callback that behaves like a subroutine: it is
+ * entered by JSR (or JMP) and, unless it says otherwise, returns to the
+ * caller as if by RTS.  Knowing that much lets the engines call it far
+ * more cheaply than an ordinary callback.  Instead of externalising
+ * every register before the call and internalising them all after,
+ * they hand the trap a copy of A, X, Y, P, S and PC on their own stack
+ * and take back the first five of them; the JSR frame is popped by the
+ * engine rather than by the trap.  mpu->registers is not brought up to
+ * date, so the trap must use the registers it is given.
+ *
+ * A trap is installed as the call callback trapCall, which is what the
+ * engines look for.  Anything else that runs call callbacks (the DEBUG
+ * engine while counting, the lockstep checker) reaches trapCall itself,
+ * which does the same work the slow way with the externalised
+ * registers.  BRK into a trap at the IRQ/BRK handler goes to trapBreak
+ * instead: BRK pushed the status register as well as a return address,
+ * so a trap that returns zero there returns as if by RTI.
+ */
+
+struct _M6502_Traps
+{
+  M6502_Trap	trap[0x10000];
+};
+
+
+/* a trap that clears I lets a held interrupt request in, as unmask()
+ * does in the engines */
+
+static void trapUnmask(M6502 *mpu)
+{
+  if (!(mpu->registers->p & flagI) && mpu->events->masked)
+    eventsUnmask(mpu);
+}
+
+
+static int trapCall(M6502 *mpu, uint16_t address, uint8_t data)
+{
+  M6502_Registers *r= mpu->registers;
+  M6502_Trap	   trap= mpu->traps ? mpu->traps->trap[address] : 0;
+  int		   addr;
+
+  if (!trap)
+    return 0;
+  addr= trap(mpu, address, r);
+  trapUnmask(mpu);
+  if (addr)
+    return addr;
+  addr  = mpu->memory[0x0100 + ++r->s];
+  addr |= mpu->memory[0x0100 + ++r->s] << 8;
+  return (word)(addr + 1);
+}
+
+
+/* BRK into the trap at address, the IRQ/BRK handler: answers the
+ * address to continue from, with the registers up to date */
+
+static int trapBreak(M6502 *mpu, uint16_t address, uint8_t data)
+{
+  M6502_Registers *r= mpu->registers;
+  int		   addr;
+
+  r->pc= address;
+  if (!(addr= mpu->traps->trap[address](mpu, address, r)))
+    {
+      r->p  = mpu->memory[0x0100 + ++r->s];
+      addr  = mpu->memory[0x0100 + ++r->s];
+      addr |= mpu->memory[0x0100 + ++r->s] << 8;
+    }
+  r->pc= addr;
+  trapUnmask(mpu);
+  return addr;
+}
+
+
+void M6502_setTrap(M6502 *mpu, uint16_t address, M6502_Trap trap)
+{
+  if (trap)
+    {
+      if (!mpu->traps && !(mpu->traps= calloc(1, sizeof(struct _M6502_Traps))))
+	outOfMemory();
+      mpu->traps->trap[address]= trap;
+      mpu->callbacks->call[address]= trapCall;
+    }
+  else if (trapCall == mpu->callbacks->call[address])
+    {
+      if (mpu->traps) mpu->traps->trap[address]= 0;
+      mpu->callbacks->call[address]= 0;
+    }
+}
+
+
+M6502_Trap M6502_getTrap(M6502 *mpu, uint16_t address)
+{
+  if (mpu->traps && (trapCall == mpu->callbacks->call[address]))
+    return mpu->traps->trap[address];
+  return 0;
+}
+
+
+static void trapsDelete(M6502 *mpu)
+{
+  free(mpu->traps);
+  mpu->traps= 0;
+}
@@ -24,10 +24,13 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
+#include <dlfcn.h>
 
 #include "config.h"
 #include "lib6502.h"
+#include "run6502_plugin.h"
 
 #define VERSION	PACKAGE_NAME " " PACKAGE_VERSION " " PACKAGE_COPYRIGHT
 
@@ -36,7 +39,14 @@ typedef uint16_t word;
 
 static char *program= 0;
 
-static byte bank[0x10][0x4000];
+static M6502_ROM *bank[0x10];		/* paged ROMs (see doBtraps) */
+static const char *romPool= 0;		/* --share directory */
+
+static int lockstep= 0;
+static int lockstepEngine= M6502_LockstepStep;
+static int plugins= 0;
+
+static unsigned long timerPeriod= 0;
 
 
 void fail(const char *fmt, ...)
@@ -59,20 +69,26 @@ void pfail(const char *msg)
 }
 
 
-#define rts							\
-  {								\
-    word pc;							\
-    pc  = mpu->memory[++mpu->registers->s + 0x100];		\
-    pc |= mpu->memory[++mpu->registers->s + 0x100] << 8;	\
-    return pc + 1;						\
-  }
+static void usage(int status);
+static void reportStop(M6502 *mpu);
+
+#include "run6502_journal.c"
+#include "run6502_input.c"
+#include "run6502_gdb.c"
+#include "run6502_profile.c"
+#include "run6502_cc65.c"
+#include "run6502_stats.c"
+#include "run6502_sample.c"
+#include "run6502_coverage.c"
+#include "run6502_heatmap.c"
+#include "run6502_cache.c"
 
 
-int osword(M6502 *mpu, word address, byte data)
+int osword(M6502 *mpu, word address, M6502_Registers *r)
 {
-  byte *params= mpu->memory + mpu->registers->x + (mpu->registers->y << 8);
+  byte *params= mpu->memory + r->x + (r->y << 8);
 
-  switch (mpu->registers->a)
+  switch (r->a)
     {
     case 0x00: /* input line */
       /* On entry: XY+0,1=>string area,
@@ -86,23 +102,31 @@ int osword(M6502 *mpu, word address, byte data)
 	word  offset= params[0] + (params[1] << 8);
 	byte *buffer= mpu->memory + offset;
 	byte  length= params[2], minVal= params[3], maxVal= params[4], b= 0;
-	if (!fgets(buffer, length, stdin))
+	int   c= 0;
+	for (b= 0;  (b + 1 < length) && ('\n' != c);  ++b)	/* as fgets(3) */
 	  {
-	    putchar('\n');
-	    exit(0);
+	    if (EOF == (c= inputGet(1)))
+	      {
+		if (b) break;
+		putchar('\n');
+		exit(0);
+	      }
+	    buffer[b]= c;
 	  }
+	if (b < length) buffer[b]= '\0';
 	for (b= 0;  b < length;  ++b)
 	  if ((buffer[b] < minVal) || (buffer[b] > maxVal) || ('\n' == buffer[b]))
 	    break;
 	buffer[b]= 13;
-	mpu->registers->y= b;
-	mpu->registers->p &= 0xFE;
+	r->y= b;
+	r->p &= 0xFE;
 	break;
       }
 
     default:
       {
 	char state[64];
+	*mpu->registers= *r;
 	M6502_dump(mpu, state);
 	fflush(stdout);
 	fprintf(stderr, "\nOSWORD %s\n", state);
@@ -111,16 +135,16 @@ int osword(M6502 *mpu, word address, byte data)
       break;
     }
   
-  rts;
+  return 0;
 }
 
 
-int osbyte(M6502 *mpu, word address, byte data)
+int osbyte(M6502 *mpu, word address, M6502_Registers *r)
 {
-  switch (mpu->registers->a)
+  switch (r->a)
     {
     case 0x7A:	/* perform keyboard scan */
-      mpu->registers->x= 0x00;
+      r->x= 0x00;
       break;
 
     case 0x7E:	/* acknowledge detection of escape condition */
@@ -128,30 +152,31 @@ int osbyte(M6502 *mpu, word address, byte data)
       break;
 
     case 0x82:	/* read machine higher order address */
-      mpu->registers->y= 0x00;
-      mpu->registers->x= 0x00;
+      r->y= 0x00;
+      r->x= 0x00;
       break;
 
     case 0x83:	/* read top of OS ram address (OSHWM) */
-      mpu->registers->y= 0x0E;
-      mpu->registers->x= 0x00;
+      r->y= 0x0E;
+      r->x= 0x00;
       break;
 
     case 0x84:	/* read bottom of display ram address */
-      mpu->registers->y= 0x80;
-      mpu->registers->x= 0x00;
+      r->y= 0x80;
+      r->x= 0x00;
       break;
 
     case 0x89:	/* motor control */
       break;
 
     case 0xDA:	/* read/write number of items in vdu queue (stored at 0x026A) */
-      return 0;
+      return address;
       break;
 
     default:
       {
 	char state[64];
+	*mpu->registers= *r;
 	M6502_dump(mpu, state);
 	fflush(stdout);
 	fprintf(stderr, "\nOSBYTE %s\n", state);
@@ -160,13 +185,13 @@ int osbyte(M6502 *mpu, word address, byte data)
       break;
     }
 
-  rts;
+  return 0;
 }
 
 
-int oscli(M6502 *mpu, word address, byte data)
+int oscli(M6502 *mpu, word address, M6502_Registers *r)
 {
-  byte *params= mpu->memory + mpu->registers->x + (mpu->registers->y << 8);
+  byte *params= mpu->memory + r->x + (r->y << 8);
   char  command[1024], *ptr= command;
   while (('*' == *params) || (' ' == *params))
     ++params;
@@ -174,24 +199,24 @@ int oscli(M6502 *mpu, word address, byte data)
     *ptr++= *params++;
   *ptr= '\0';
   system(command);
-  rts;
+  return 0;
 }
 
 
-int oswrch(M6502 *mpu, word address, byte data)
+int oswrch(M6502 *mpu, word address, M6502_Registers *r)
 {
-  switch (mpu->registers->a)
+  switch (r->a)
     {
     case 0x0C:
       fputs("\033[2J\033[H", stdout);
       break;
 
     default:
-      putchar(mpu->registers->a);
+      putchar(r->a);
       break;
     }
   fflush(stdout);
-  rts;
+  return 0;
 }
 
 
@@ -201,15 +226,27 @@ static int writeROM(M6502 *mpu, word address, byte value)
 }
 
 
+/* mapping a bank costs a system call and a fault on the first access
+ * to each page, which is only worth it when the pages are shared with
+ * other processes; otherwise it is cheaper to copy */
+
 static int bankSelect(M6502 *mpu, word address, byte value)
 {
-  memcpy(mpu->memory + 0x8000, bank[value & 0x0F], 0x4000);
+  M6502_ROM *rom= bank[value & 0x0F];
+  if (romPool)
+    M6502_mapROM(mpu, 0x8000, rom);
+  else
+    {
+      memcpy(mpu->memory + 0x8000, rom->data, 0x4000);
+      M6502_touch(mpu, 0x8000, 0xBFFF);
+    }
   return 0;
 }
 
 
 static int doBtraps(int argc, char **argv, M6502 *mpu)
 {
+  static const byte empty[0x4000];
   unsigned addr;
 
   /* Acorn Model B ROM and memory-mapped IO */
@@ -222,11 +259,15 @@ static int doBtraps(int argc, char **argv, M6502 *mpu)
 
   /* anything already loaded at 0x8000 appears in bank 0 */
 
-  memcpy(bank[0x00], mpu->memory + 0x8000, 0x4000);
+  bank[0x00]= M6502_newROM(mpu->memory + 0x8000, 0x4000, romPool);
+  M6502_mapROM(mpu, 0x8000, bank[0x00]);
+  for (addr= 0x01;  addr <= 0x0F;  ++addr)
+    if (!bank[addr])
+      bank[addr]= M6502_newROM(empty, 0x4000, romPool);
 
   /* fake a few interesting OS calls */
 
-# define trap(vec, addr, func)   mpu->callbacks->call[addr]= (func)
+# define trap(vec, addr, func)   M6502_setTrap(mpu, addr, func)
   trap(0x020C, 0xFFF1, osword);
   trap(0x020A, 0xFFF4, osbyte);
 //trap(0x0208, 0xFFF7, oscli );	/* enable this to send '*COMMAND's to system(3) :-) */
@@ -246,18 +287,40 @@ static void usage(int status)
   fprintf(stream, "\n");
   fprintf(stream, "usage: %s [option ...]\n", program);
   fprintf(stream, "       %s [option ...] -B [image ...]\n", program);
+  fprintf(stream, "  -A                -- print the basic blocks of the code found from the vectors\n");
+  fprintf(stream, "  -b addr[:cond]    -- stop before executing addr (if cond is true)\n");
   fprintf(stream, "  -B                -- minimal Acorn 'BBC Model B' compatibility\n");
+  fprintf(stream, "  -c                -- do not use the results cache\n");
+  fprintf(stream, "  -C dir            -- reuse the output of identical runs saved in dir\n");
+  fprintf(stream, "  --coverage dbg file -- add the source lines executed (from ld65 --dbgfile dbg) to lcov file\n");
   fprintf(stream, "  -d addr last      -- dump memory between addr and last\n");
+  fprintf(stream, "  -D file[:args]    -- load device plugin from file\n");
+  fprintf(stream, "  -F file           -- read guest input from file (or file descriptor number)\n");
+  fprintf(stream, "  -g address        -- wait for gdb to attach at address ('[host]:port' or socket path)\n");
   fprintf(stream, "  -G addr           -- emulate getchar(3) at addr\n");
   fprintf(stream, "  -h                -- help (print this message)\n");
+  fprintf(stream, "  --heatmap file[:n] -- write reads, writes and executions per page and the n hottest addresses\n");
+  fprintf(stream, "  -H labels         -- run cc65 runtime helpers natively (ld65 -Ln file, or 'scan')\n");
   fprintf(stream, "  -I addr           -- set IRQ vector\n");
+  fprintf(stream, "  -j file           -- record the guest's input in file\n");
+  fprintf(stream, "  -J file           -- replay the guest's input recorded in file\n");
   fprintf(stream, "  -l addr file      -- load file at addr\n");
+  fprintf(stream, "  -L engine         -- run a second instance in lockstep ('step' or 'run'), stop if they diverge\n");
+  fprintf(stream, "  -m model          -- emulate model '6502' (NMOS) or '65c02' (CMOS, default)\n");
   fprintf(stream, "  -M addr           -- emulate memory-mapped stdio at addr\n");
   fprintf(stream, "  -N addr           -- set NMI vector\n");
+  fprintf(stream, "  -O file           -- write opcode pair and triple counts to file\n");
   fprintf(stream, "  -P addr           -- emulate putchar(3) at addr\n");
   fprintf(stream, "  -R addr           -- set RST vector\n");
+  fprintf(stream, "  -r range[:cond]   -- stop after reading from range ('addr' or 'addr-last')\n");
   fprintf(stream, "  -s addr last file -- save memory from addr to last in file\n");
+  fprintf(stream, "  --sample file[:us] -- sample the PC and call stack every 'us' microseconds of CPU time\n");
+  fprintf(stream, "  --share dir       -- share the pages of loaded images and ROMs with other processes through dir\n");
+  fprintf(stream, "  --stats file      -- write performance counters to file ('-' for stdout) as JSON\n");
+  fprintf(stream, "  -T cycles         -- raise an IRQ every 'cycles' clock cycles\n");
   fprintf(stream, "  -v                -- print version number then exit\n");
+  fprintf(stream, "  -W policy         -- when no input is waiting: 'block', return 'empty', or 'irq'\n");
+  fprintf(stream, "  -w range[:cond]   -- stop after writing to range ('addr' or 'addr-last')\n");
   fprintf(stream, "  -X addr           -- terminate emulation if PC reaches addr\n");
   fprintf(stream, "  -x                -- exit wihout further ado\n");
   fprintf(stream, "  image             -- '-l 8000 image' in available ROM slot\n");
@@ -333,15 +396,21 @@ static int load(M6502 *mpu, word address, const char *path)
 {
   FILE  *file= 0;
   int    count= 0;
-  size_t max= 0x10000 - address;
+  size_t max= 0x10000 - address, size= 0;
   if (!(file= fopen(path, "r")))
     return 0;
-  while ((count= fread(mpu->memory + address, 1, max, file)) > 0)
+  while ((count= fread(mpu->memory + address + size, 1, max, file)) > 0)
     {
-      address += count;
+      size += count;
       max -= count;
     }
   fclose(file);
+  if (romPool)	/* share the pages of the image with other processes */
+    {
+      M6502_ROM *rom= M6502_newROM(mpu->memory + address, size, romPool);
+      M6502_mapROM(mpu, address, rom);
+      M6502_deleteROM(rom);
+    }
   return 1;
 }
 
@@ -386,29 +455,124 @@ doVEC(RST);
 
 #undef doVEC
 
+
+/* periodic timer interrupt: rescheduled relative to when it was due
+ * (not when it ran) so that the period does not drift
+ */
+
+static void timerEvent(M6502 *mpu, uint64_t when, void *data)
+{
+  M6502_scheduleIRQ(mpu, when);
+  M6502_schedule(mpu, when + timerPeriod, timerEvent, 0);
+}
+
+static int doTimer(int argc, char **argv, M6502 *mpu)
+{
+  if (argc < 2) usage(1);
+  if (!(timerPeriod= htol(argv[1]))) fail("timer period must be non-zero");
+  return 1;
+}
+
+static int doLockstep(int argc, char **argv, M6502 *mpu)	/* -L engine */
+{
+  if (argc < 2) usage(1);
+  if      (!strcmp(argv[1], "step"))	lockstepEngine= M6502_LockstepStep;
+  else if (!strcmp(argv[1], "run"))	lockstepEngine= M6502_LockstepRun;
+  else fail("unknown lockstep engine: %s", argv[1]);
+  lockstep= 1;
+  return 1;
+}
+
 /*
 	generic configureable "kernel" trap - getchar
 */
-static int gTrap(M6502 *mpu, word addr, byte data)
+static int gTrap(M6502 *mpu, word addr, M6502_Registers *r)
 {
-	mpu->registers->a= getchar();
-	rts;
+	int c= inputGet(inputBlock == input.policy);
+	if (INPUT_NONE == c)
+	  r->p |= 0x01;	/* C: nothing available */
+	else
+	  {
+	    r->a= c;
+	    if (inputBlock != input.policy) r->p &= 0xFE;
+	  }
+	return 0;
 }
 /*
 	generic configureable "kernel" trap - putchar
 */
-static int pTrap(M6502 *mpu, word addr, byte data)
+static int pTrap(M6502 *mpu, word addr, M6502_Registers *r)
 {
-	putchar(mpu->registers->a);
-	rts;
+	putchar(r->a);
+	return 0;
 }
 
-static int eTrap(M6502 *mpu, word addr, byte data)
+static int eTrap(M6502 *mpu, word addr, M6502_Registers *r)
 {
-	printf("> error:%d\n",mpu->registers->a);
+	printf("> error:%d\n",r->a);
 	M6502_log_printall();
 	printf("<\n");
-	rts;
+	return 0;
+}
+
+/*
+	loadable devices (see run6502_plugin.h)
+*/
+static void pluginMap(Run6502_Host *host, word first, word last, M6502_Callback read, M6502_Callback write)
+{
+  M6502 *mpu= host->mpu;
+  unsigned addr;
+  if (first > last) fail("%s: empty address range %04X-%04X", host->name, first, last);
+  for (addr= first;  addr <= last;  ++addr)
+    if ((read  && M6502_getCallback(mpu, read,  addr)) ||
+	(write && M6502_getCallback(mpu, write, addr)))
+      fail("%s: address %04X is already claimed by another device", host->name, addr);
+  for (addr= first;  addr <= last;  ++addr)
+    {
+      if (read)  M6502_setCallback(mpu, read,  addr, read);
+      if (write) M6502_setCallback(mpu, write, addr, write);
+    }
+}
+
+static void pluginTrap(Run6502_Host *host, word addr, M6502_Callback call)
+{
+  if (M6502_getCallback(host->mpu, call, addr))
+    fail("%s: trap at %04X is already claimed", host->name, addr);
+  M6502_setCallback(host->mpu, call, addr, call);
+}
+
+static int doPlugin(int argc, char **argv, M6502 *mpu)	/* -D file[:args] */
+{
+  Run6502_Host	     *host;
+  char		     *path, *args;
+  void		     *handle;
+  Run6502_PluginInit  init;
+
+  if (argc < 2) usage(1);
+  if (!(path= strdup(argv[1]))) fail("out of memory");
+  if ((args= strchr(path, ':')))  *args++= '\0';
+  else				  args= "";
+  if (!(handle= dlopen(path, RTLD_NOW | RTLD_LOCAL)))
+    fail("%s", dlerror());
+  if (!(init= (Run6502_PluginInit)dlsym(handle, RUN6502_PLUGIN_INIT)))
+    fail("%s: not a run6502 plugin (no %s)", path, RUN6502_PLUGIN_INIT);
+
+  /* the plugin may keep host for use by its callbacks */
+  if (!(host= calloc(1, sizeof(Run6502_Host)))) fail("out of memory");
+  host->version=  RUN6502_PLUGIN_VERSION;
+  host->mpu=      mpu;
+  host->name=     path;
+  host->map=      pluginMap;
+  host->trap=     pluginTrap;
+  host->schedule= M6502_schedule;
+  host->cancel=   M6502_cancel;
+  host->scheduleIRQ= M6502_scheduleIRQ;
+  host->scheduleNMI= M6502_scheduleNMI;
+  host->fail=     fail;
+  if (!init(host, args))
+    fail("%s: initialisation failed", path);
+  ++plugins;
+  return 1;
 }
 
 static int doGtrap(int argc, char **argv, M6502 *mpu)
@@ -416,7 +580,7 @@ static int doGtrap(int argc, char **argv, M6502 *mpu)
   unsigned addr;
   if (argc < 2) usage(1);
   addr= htol(argv[1]);
-  M6502_setCallback(mpu, call, addr, gTrap);
+  M6502_setTrap(mpu, addr, gTrap);
   return 1;
 }
 
@@ -425,7 +589,7 @@ static int doPtrap(int argc, char **argv, M6502 *mpu)
   unsigned addr;
   if (argc < 2) usage(1);
   addr= htol(argv[1]);
-  M6502_setCallback(mpu, call, addr, pTrap);
+  M6502_setTrap(mpu, addr, pTrap);
   return 1;
 }
 
@@ -434,16 +598,52 @@ static int doEtrap(int argc, char **argv, M6502 *mpu)
   unsigned addr;
   if (argc < 2) usage(1);
   addr= htol(argv[1]);
-  M6502_setCallback(mpu, call, addr, eTrap);
+  M6502_setTrap(mpu, addr, eTrap);
   return 1;
 }
 
 /*
 	memory mapped charin/charout
 */
-static int mTrapRead(M6502 *mpu, word addr, byte data)	{ return getchar(); }
+static int mTrapRead(M6502 *mpu, word addr, byte data)
+{
+  int c= inputGet(inputBlock == input.policy);
+  return (INPUT_NONE == c) ? 0 : (byte)c;
+}
 static int mTrapWrite(M6502 *mpu, word addr, byte data)	{ return putchar(data); }
 
+/* status register at addrio+1 when reads do not block: bit 7 set when
+ * a character (or the end of input) is waiting */
+static int mTrapStatus(M6502 *mpu, word addr, byte data)	{ return inputReady() ? 0x80 : 0x00; }
+
+/* called when the guest is found spinning in an idle loop (see
+ * M6502_setIdle).  a loop that reads only memory can be skipped up to
+ * the next event.  one that reads the -M traps (the only read callbacks
+ * run6502 installs itself) sees a change only when input arrives, so it
+ * too can be skipped while the ring is empty, and if nothing else is
+ * pending the host sleeps until there is input.  with -W irq the input
+ * poll is always pending, so the host also sleeps when the next event
+ * is the poll and nothing (timer, gdb, plugin) could schedule another:
+ * only input can then make the poll raise IRQ.  plugin devices could
+ * change at any time.
+ */
+static int idleWait(M6502 *mpu, uint64_t until, int io)
+{
+  int polling= (inputIRQ == input.policy) && (until == input.poll) && !timerPeriod && !gdb.address && !plugins;
+  if (!io)
+    {
+      if (polling) inputWait();	/* returns at once if input is waiting */
+      return 1;
+    }
+  if (plugins || (inputBlock == input.policy) || inputReady()) return 0;
+  if (polling || (~(uint64_t)0 == until))
+    {
+      inputWait();
+      return 0;
+    }
+  return 1;
+}
+
 static int doMtrap(int argc, char **argv, M6502 *mpu)
 {
   unsigned addr= 0;
@@ -461,6 +661,56 @@ static int xTrap(M6502 *mpu, word addr, byte data)
 	return 0;
 }
 
+/*
+	breakpoints and watchpoints (addr[:condition], first[-last][:condition])
+*/
+static char *splitCondition(char *arg)
+{
+  char *cond= strchr(arg, ':');
+  if (cond) *cond++= '\0';
+  return cond;
+}
+
+static int doBreak(int argc, char **argv, M6502 *mpu)
+{
+  char *cond;
+  if (argc < 2) usage(1);
+  cond= splitCondition(argv[1]);
+  if (!M6502_setBreakpoint(mpu, htol(argv[1]), cond))
+    fail("bad breakpoint condition: %s", cond);
+  return 1;
+}
+
+static int doWatch(int argc, char **argv, M6502 *mpu)
+{
+  char *cond, *dash;
+  unsigned first, last;
+  if (argc < 2) usage(1);
+  cond= splitCondition(argv[1]);
+  if ((dash= strchr(argv[1], '-')))
+    {
+      *dash++= '\0';
+      last= htol(dash);
+    }
+  first= htol(argv[1]);
+  if (!dash) last= first;
+  if (!M6502_setWatchpoint(mpu, first, last, ('r' == argv[0][1]) ? M6502_WatchRead : M6502_WatchWrite, cond))
+    fail("bad watchpoint: %s", cond ? cond : argv[1]);
+  return 1;
+}
+
+static void reportStop(M6502 *mpu)
+{
+  char reason[64], state[64], insn[64];
+  if (!M6502_stopped(mpu, reason))
+    return;
+  M6502_dump(mpu, state);
+  M6502_disassemble(mpu, mpu->registers->pc, insn);
+  fflush(stdout);
+  fprintf(stderr, "\n%s\n%s  %04X %s\n", reason, state, mpu->registers->pc, insn);
+}
+
+
 static int doXtrap(int argc, char **argv, M6502 *mpu)
 {
   unsigned addr= 0;
@@ -471,36 +721,90 @@ static int doXtrap(int argc, char **argv, M6502 *mpu)
 }
 
 
+/* the model is fixed when the processor is created, so -m is picked
+ * out of the arguments before any of the others are processed
+ */
+
+static const char *getPool(int argc, char **argv)
+{
+  const char *pool= 0;
+  while (++argv, --argc > 0)
+    if (!strcmp(*argv, "--share"))
+      {
+	if (argc < 2) usage(1);
+	pool= argv[1];
+      }
+  return pool;
+}
+
+
+static int getModel(int argc, char **argv)
+{
+  int model= M6502_CMOS;
+  while (++argv, --argc > 0)
+    if (!strcmp(*argv, "-m"))
+      {
+	if (argc < 2) usage(1);
+	if      (!strcasecmp(argv[1], "6502")  || !strcasecmp(argv[1], "nmos"))  model= M6502_NMOS;
+	else if (!strcasecmp(argv[1], "65c02") || !strcasecmp(argv[1], "cmos"))  model= M6502_CMOS;
+	else fail("unknown processor model: %s", argv[1]);
+      }
+  return model;
+}
+
+
 static int doDisassemble(int argc, char **argv, M6502 *mpu)
 {
   unsigned addr= 0, last= 0;
+  char	   buffer[16384];
   if (argc < 3) usage(1);
   addr= htol(argv[1]);
   last= ('+' == *argv[2]) ? addr + htol(1 + argv[2]) : htol(argv[2]);
   while (addr < last)
     {
-      char insn[64];
-      int  i= 0, size= M6502_disassemble(mpu, addr, insn);
-      printf("%04X ", addr);
-      while (i++ < size)  printf("%02X", mpu->memory[addr + i - 1]);
-      while (i++ < 4)     printf("  ");
-      putchar(' ');
-      i= 0;
-      while (i++ < size)  putchar(isgraph(mpu->memory[addr + i - 1]) ? mpu->memory[addr + i - 1] : ' ');
-      while (i++ < 4)     putchar(' ');
-      printf(" %s\n", insn);
-      addr += size;
+      addr += M6502_disassembleRange(mpu, addr, last - addr, buffer, sizeof(buffer), 0, 0);
+      fputs(buffer, stdout);
     }
   return 2;
 }
 
 
+static int doAnalyse(int argc, char **argv, M6502 *mpu)	/* -A */
+{
+  M6502_Analysis *a= M6502_analyse(mpu, 0, 0);
+  int		  i;
+  for (i= 0;  i < a->count;  ++i)
+    {
+      M6502_Block *b= a->blocks + i;
+      printf("%04X-%04X", b->first, (word)(b->first + b->size - 1));
+      if (b->flags & M6502_Jumps)
+	printf(" %s %04X", (b->flags & M6502_Calls) ? "call" : (b->flags & M6502_Falls) ? "branch" : "jump", b->target);
+      if (b->flags & M6502_Falls)	printf(" next %04X", b->next);
+      if (b->flags & M6502_Returns)	printf(" return");
+      if (b->flags & M6502_Indirect)	printf(" indirect");
+      if (b->flags & M6502_Stops)	printf(" stop");
+      if (b->flags & M6502_Modified)	printf(" modified");
+      if (a->map[b->first] & M6502_Entry) printf(" entry");
+      putchar('\n');
+    }
+  M6502_deleteAnalysis(a);
+  return 0;
+}
+
+
 int main(int argc, char **argv)
 {
-  M6502 *mpu= M6502_new(0, 0, 0);
+  M6502 *mpu= 0;
   int bTraps= 0;
 
   program= argv[0];
+  cache.argc= argc;
+  cache.argv= argv;
+  cache.dir= getenv("RUN6502_CACHE");
+
+  if (!(mpu= M6502_newModel(getModel(argc, argv), 0, 0, 0)))
+    fail("processor model not supported by this build");
+  romPool= getPool(argc, argv);
 
   if ((2 == argc) && ('-' != *argv[1]))
     {
@@ -513,19 +817,41 @@ int main(int argc, char **argv)
       {
 	int n= 0;
 	if      (!strcmp(*argv, "-B"))  bTraps= 1;
+	else if (!strcmp(*argv, "-A"))	n= doAnalyse(argc, argv, mpu);
+	else if (!strcmp(*argv, "-b"))	n= doBreak(argc, argv, mpu);
+	else if (!strcmp(*argv, "-c"))	cache.bypass= 1;
+	else if (!strcmp(*argv, "-C"))	n= doCache(argc, argv, mpu);
+	else if (!strcmp(*argv, "--coverage")) n= doCoverage(argc, argv, mpu);
 	else if (!strcmp(*argv, "-d"))	n= doDisassemble(argc, argv, mpu);
+	else if (!strcmp(*argv, "-D"))	n= doPlugin(argc, argv, mpu);
+	else if (!strcmp(*argv, "-F"))	n= doInput(argc, argv, mpu);
+	else if (!strcmp(*argv, "-g"))	n= doGdb(argc, argv, mpu);
 	else if (!strcmp(*argv, "-G"))	n= doGtrap(argc, argv, mpu);
 	else if (!strcmp(*argv, "-E"))	n= doEtrap(argc, argv, mpu);
 	else if (!strcmp(*argv, "-h"))	n= doHelp(argc, argv, mpu);
+	else if (!strcmp(*argv, "-H"))	n= doHle(argc, argv, mpu);
+	else if (!strcmp(*argv, "--heatmap")) n= doHeatmap(argc, argv, mpu);
 	else if (!strcmp(*argv, "-i"))	n= doLoadInterpreter(argc, argv, mpu);
 	else if (!strcmp(*argv, "-I"))	n= doIRQ(argc, argv, mpu);
+	else if (!strcmp(*argv, "-j"))	n= doJournal(argc, argv, mpu);
+	else if (!strcmp(*argv, "-J"))	n= doJournal(argc, argv, mpu);
 	else if (!strcmp(*argv, "-l"))	n= doLoad(argc, argv, mpu);
+	else if (!strcmp(*argv, "-L"))	n= doLockstep(argc, argv, mpu);
+	else if (!strcmp(*argv, "-m"))	n= 1;	/* see getModel() */
 	else if (!strcmp(*argv, "-M"))	n= doMtrap(argc, argv, mpu);
+	else if (!strcmp(*argv, "-O"))	n= doProfile(argc, argv, mpu);
 	else if (!strcmp(*argv, "-N"))	n= doNMI(argc, argv, mpu);
 	else if (!strcmp(*argv, "-P"))	n= doPtrap(argc, argv, mpu);
 	else if (!strcmp(*argv, "-R"))	n= doRST(argc, argv, mpu);
+	else if (!strcmp(*argv, "-r"))	n= doWatch(argc, argv, mpu);
 	else if (!strcmp(*argv, "-s"))	n= doSave(argc, argv, mpu);
+	else if (!strcmp(*argv, "--sample")) n= doSample(argc, argv, mpu);
+	else if (!strcmp(*argv, "--share")) n= 1;	/* see getPool() */
+	else if (!strcmp(*argv, "--stats")) n= doStats(argc, argv, mpu);
+	else if (!strcmp(*argv, "-T"))	n= doTimer(argc, argv, mpu);
 	else if (!strcmp(*argv, "-v"))	n= doVersion(argc, argv, mpu);
+	else if (!strcmp(*argv, "-w"))	n= doWatch(argc, argv, mpu);
+	else if (!strcmp(*argv, "-W"))	n= doWait(argc, argv, mpu);
 	else if (!strcmp(*argv, "-X"))	n= doXtrap(argc, argv, mpu);
 	else if (!strcmp(*argv, "-t"))	mpu->flags|=M6502_TraceExecution;
 	else if (!strcmp(*argv, "-x"))	exit(0);
@@ -538,9 +864,7 @@ int main(int argc, char **argv)
 	    if (!bTraps)			usage(1);
 	    if (bankSel < 0)			fail("too many images");
 	    if (!load(mpu, 0x8000, argv[0]))	pfail(argv[0]);
-	    memcpy(bank[bankSel--],
-		   0x8000 + mpu->memory,
-		   0x4000);
+	    bank[bankSel--]= M6502_newROM(mpu->memory + 0x8000, 0x4000, romPool);
 	    n= 1;
 	  }
 	argc -= n;
@@ -550,8 +874,80 @@ int main(int argc, char **argv)
   if (bTraps)
     doBtraps(0, 0, mpu);
 
+  if (hle.labels)
+    hleStart(mpu);
+
+  cacheStart(mpu);
+
   M6502_reset(mpu);
-  M6502_run(mpu);
+
+  if (inputBlock != input.policy)
+    {
+      unsigned addr;
+      for (addr= 0;  addr < 0xFFFF;  ++addr)
+	if (mTrapRead == M6502_getCallback(mpu, read, addr))
+	  {
+	    if (M6502_getCallback(mpu, read, addr + 1))
+	      fail("-M %04X: the status register at %04X is already claimed", addr, addr + 1);
+	    M6502_setCallback(mpu, read, addr + 1, mTrapStatus);
+	  }
+      if (inputIRQ == input.policy)
+	{
+	  inputStart();
+	  M6502_schedule(mpu, input.poll= INPUT_POLL, inputPoll, 0);
+	}
+    }
+
+  if (timerPeriod)
+    M6502_schedule(mpu, timerPeriod, timerEvent, 0);
+
+  journalStart(mpu);
+
+  if (stats.path)
+    statsStart(mpu);
+
+  if (sample.path)
+    sampleStart(mpu);
+
+  if (coverage.path)
+    coverageStart(mpu);
+
+  if (heatmap.path)
+    heatmapStart(mpu);
+
+  M6502_setIdle(mpu, idleWait);
+
+  if (gdb.address)
+    gdbServe(mpu);
+  else if (profile.path)
+    profileRun(mpu);
+  else if (lockstep)
+    {
+      M6502 *twin= M6502_newModel(mpu->model, 0, 0, 0);
+      unsigned addr;
+      memcpy(twin->memory, mpu->memory, sizeof(M6502_Memory));
+      memcpy(twin->callbacks, mpu->callbacks, sizeof(M6502_Callbacks));
+      for (addr= 0;  addr < 0x10000;  ++addr)	/* the candidate runs them with -L run */
+	if (M6502_getTrap(mpu, addr))
+	  M6502_setTrap(twin, addr, M6502_getTrap(mpu, addr));
+      *twin->registers= *mpu->registers;
+      M6502_setIdle(twin, idleWait);
+      if (timerPeriod)
+	M6502_schedule(twin, timerPeriod, timerEvent, 0);
+      if (M6502_lockstep(mpu, twin, lockstepEngine, 0, stderr))
+	exit(1);
+      M6502_delete(twin);
+    }
+  else
+    {
+      M6502_run(mpu);
+      reportStop(mpu);
+    }
+
+  statsWrite();
+  sampleWrite();
+  coverageWrite();
+  heatmapWrite();
   M6502_delete(mpu);
 
   return 0;
@@ -0,0 +1,339 @@
+/* run6502_cache.c -- results cache (-C)				-*- C -*- */
+
+/* With -C dir (or RUN6502_CACHE=dir in the environment) a run is
+ * identified by a hash of everything that can affect what it does: the
+ * run6502 executable, the command line, the memory and paged ROMs and
+ * callbacks as they are once the options have been processed, and the
+ * guest's input (which is read in full before the program starts).  If
+ * dir already holds the result of a run with the same hash, the stdout,
+ * stderr and exit status it recorded are reproduced without running the
+ * program.  Otherwise the program runs in a child process whose output
+ * is copied as it arrives and saved, along with its exit status, under
+ * the hash in dir.
+ *
+ * The counts of hits and misses are kept in dir/stats.  -c bypasses
+ * the cache (for this run only).  Runs that involve something outside
+ * run6502 (plugins, a debugger, a profile, sample, statistics,
+ * coverage, heatmap or journal file, or input from a terminal) are
+ * never cached, and nor are those whose input is not read in the
+ * blocking way (-W empty or irq): the program would see all of it at
+ * once rather than when it arrives.
+ *
+ * The hash is not cryptographic: dir should be trusted.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/file.h>
+#include <signal.h>
+
+#define CACHE_MAGIC	"run6502-cache 1"
+
+static struct
+{
+  const char	*dir;		/* -C argument, or 0 */
+  int		 bypass;	/* -c */
+  int		 argc;		/* the command line (see cacheHash()) */
+  char		**argv;
+  uint64_t	 hash[2];
+} cache;
+
+typedef struct
+{
+  char	 *bytes;
+  size_t  size, capacity;
+} CacheBuffer;
+
+
+static void cacheAppend(CacheBuffer *b, const void *bytes, size_t size)
+{
+  if (b->size + size > b->capacity)
+    {
+      b->capacity= 2 * (b->size + size) + 4096;
+      if (!(b->bytes= realloc(b->bytes, b->capacity))) fail("out of memory");
+    }
+  memcpy(b->bytes + b->size, bytes, size);
+  b->size += size;
+}
+
+
+/* two 64-bit hashes in parallel: FNV-1a, and the same with a
+ * different basis and a multiplier from the golden ratio
+ */
+
+static void cacheMix(const void *bytes, size_t size)
+{
+  const byte *p= bytes;
+  while (size--)
+    {
+      cache.hash[0]= (cache.hash[0] ^ *p)   * 0x100000001B3ULL;
+      cache.hash[1]= (cache.hash[1] ^ *p++) * 0x9E3779B97F4A7C15ULL + 1;
+    }
+}
+
+
+static void cacheMixFile(int fd)
+{
+  char	  buf[65536];
+  ssize_t n;
+  while ((n= read(fd, buf, sizeof(buf))) > 0)
+    cacheMix(buf, n);
+}
+
+
+/* callbacks are hashed as offsets from a function in run6502 so that
+ * the hash does not depend on where the executable was loaded
+ */
+
+static void cacheMixCallbacks(M6502_Callback *table)
+{
+  int i;
+  for (i= 0;  i < 0x10000;  ++i)
+    {
+      int64_t offset= table[i] ? (intptr_t)table[i] - (intptr_t)usage : 0;
+      cacheMix(&offset, sizeof(offset));
+    }
+}
+
+
+/* answers a file descriptor open on a copy of the guest's input, or -1
+ * if the input cannot be known in advance
+ */
+
+static int cacheInput(void)
+{
+  char	  path[1024], buf[65536];
+  ssize_t n;
+  int	  fd;
+
+  if (isatty(input.fd)) return -1;
+  snprintf(path, sizeof(path), "%s/input.XXXXXX", cache.dir);
+  if ((fd= mkstemp(path)) < 0) pfail(path);
+  unlink(path);
+  while ((n= read(input.fd, buf, sizeof(buf))) != 0)
+    {
+      if (n < 0)
+	{
+	  if (EINTR == errno) continue;
+	  pfail("input");
+	}
+      cacheMix(buf, n);
+      if (write(fd, buf, n) != n) pfail(path);
+    }
+  lseek(fd, 0, SEEK_SET);
+  return fd;
+}
+
+
+static void cacheHash(M6502 *mpu)
+{
+  int i, fd;
+
+  cache.hash[0]= 0xCBF29CE484222325ULL;
+  cache.hash[1]= 0x6A09E667F3BCC908ULL;
+  cacheMix(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  if ((fd= open("/proc/self/exe", O_RDONLY)) >= 0)
+    {
+      cacheMixFile(fd);
+      close(fd);
+    }
+  else
+    cacheMix(VERSION __DATE__ __TIME__, sizeof(VERSION __DATE__ __TIME__));
+  for (i= 1;  i < cache.argc;  ++i)
+    if (!strcmp(cache.argv[i], "-C"))
+      ++i;
+    else if (strcmp(cache.argv[i], "-c"))
+      cacheMix(cache.argv[i], strlen(cache.argv[i]) + 1);
+  cacheMix(mpu->memory, sizeof(M6502_Memory));
+  for (i= 0;  i < 0x10;  ++i)
+    if (bank[i])
+      cacheMix(bank[i]->data, bank[i]->length);
+  cacheMix(mpu->registers, sizeof(M6502_Registers));
+  cacheMixCallbacks(mpu->callbacks->read);
+  cacheMixCallbacks(mpu->callbacks->write);
+  cacheMixCallbacks(mpu->callbacks->call);
+}
+
+
+static void cacheCount(int hit)
+{
+  char		path[1024];
+  unsigned long hits= 0, misses= 0;
+  FILE	       *file;
+  int		fd;
+
+  snprintf(path, sizeof(path), "%s/stats", cache.dir);
+  if ((fd= open(path, O_RDWR | O_CREAT, 0666)) < 0) return;
+  flock(fd, LOCK_EX);
+  if ((file= fdopen(fd, "r+")))
+    {
+      if (2 != fscanf(file, "hits %lu misses %lu", &hits, &misses))
+	hits= misses= 0;
+      if (hit) ++hits; else ++misses;
+      rewind(file);
+      fprintf(file, "hits %lu\nmisses %lu\n", hits, misses);	/* never shorter than before */
+      fclose(file);		/* and unlock */
+    }
+  else
+    close(fd);
+}
+
+
+static void cacheWrite(int fd, const char *bytes, size_t size)
+{
+  while (size)
+    {
+      ssize_t n= write(fd, bytes, size);
+      if (n < 0)
+	{
+	  if (EINTR == errno) continue;
+	  return;
+	}
+      bytes += n;
+      size -= n;
+    }
+}
+
+
+/* reproduce a cached result and exit, or return if there is none */
+
+static void cacheReplay(const char *path)
+{
+  FILE	       *file;
+  int		status;
+  size_t	out, err;
+  CacheBuffer	b= { 0, 0, 0 };
+  char		buf[65536];
+  size_t	n;
+
+  if (!(file= fopen(path, "r"))) return;
+  if (3 != fscanf(file, CACHE_MAGIC " %d %zu %zu", &status, &out, &err) || ('\n' != fgetc(file)))
+    {
+      fclose(file);
+      return;
+    }
+  while ((n= fread(buf, 1, sizeof(buf), file)) > 0)
+    cacheAppend(&b, buf, n);
+  fclose(file);
+  if (b.size != out + err)
+    {
+      free(b.bytes);
+      return;
+    }
+  cacheCount(1);
+  cacheWrite(1, b.bytes, out);
+  cacheWrite(2, b.bytes + out, err);
+  exit(status);
+}
+
+
+/* run the program in a child, copying its output to ours, and save the
+ * result if it exits (rather than being killed)
+ */
+
+static void cacheRecord(const char *path)
+{
+  int		out[2], err[2], status;
+  CacheBuffer	b[2]= { { 0, 0, 0 }, { 0, 0, 0 } };
+  struct pollfd fds[2];
+  pid_t		pid;
+  char		tmp[1024 + 8];	/* path.XXXXXX */
+  FILE	       *file;
+  int		fd;
+
+  if (pipe(out) || pipe(err)) pfail("pipe");
+  fflush(stdout);
+  fflush(stderr);
+  if ((pid= fork()) < 0) pfail("fork");
+  if (!pid)
+    {
+      dup2(out[1], 1);
+      dup2(err[1], 2);
+      close(out[0]);  close(out[1]);
+      close(err[0]);  close(err[1]);
+      return;
+    }
+  close(out[1]);
+  close(err[1]);
+  fds[0]= (struct pollfd){ out[0], POLLIN, 0 };
+  fds[1]= (struct pollfd){ err[0], POLLIN, 0 };
+  while ((fds[0].fd >= 0) || (fds[1].fd >= 0))
+    {
+      int i;
+      if (poll(fds, 2, -1) < 0)
+	{
+	  if (EINTR == errno) continue;
+	  pfail("poll");
+	}
+      for (i= 0;  i < 2;  ++i)
+	if ((fds[i].fd >= 0) && fds[i].revents)
+	  {
+	    char    buf[4096];
+	    ssize_t n= read(fds[i].fd, buf, sizeof(buf));
+	    if (n > 0)
+	      {
+		cacheWrite(1 + i, buf, n);
+		cacheAppend(&b[i], buf, n);
+	      }
+	    else if (!n || (EINTR != errno))
+	      {
+		close(fds[i].fd);
+		fds[i].fd= -1;
+	      }
+	  }
+    }
+  while (waitpid(pid, &status, 0) < 0)
+    if (EINTR != errno)
+      pfail("waitpid");
+  cacheCount(0);
+  if (!WIFEXITED(status))
+    {
+      signal(WTERMSIG(status), SIG_DFL);
+      raise(WTERMSIG(status));
+      exit(1);
+    }
+  snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+  if (((fd= mkstemp(tmp)) >= 0) && (file= fdopen(fd, "w")))
+    {
+      fprintf(file, CACHE_MAGIC " %d %zu %zu\n", WEXITSTATUS(status), b[0].size, b[1].size);
+      if (b[0].size) fwrite(b[0].bytes, 1, b[0].size, file);
+      if (b[1].size) fwrite(b[1].bytes, 1, b[1].size, file);
+      if (fclose(file) || rename(tmp, path))	/* never leave a partial entry */
+	unlink(tmp);
+    }
+  exit(WEXITSTATUS(status));
+}
+
+
+/* called when the machine is set up and about to run: returns (in the
+ * process that should run the program) unless the result was cached
+ */
+
+static void cacheStart(M6502 *mpu)
+{
+  char path[1024];
+  int  fd;
+
+  if (!cache.dir || cache.bypass || plugins || lockstep || gdb.address || profile.path || sample.path || stats.path || coverage.path || heatmap.path || journal.path
+      || (inputBlock != input.policy))
+    return;
+  if (mkdir(cache.dir, 0777) && (EEXIST != errno)) pfail(cache.dir);
+  cacheHash(mpu);
+  if ((fd= cacheInput()) < 0)
+    return;
+  if (input.fd) close(input.fd);
+  input.fd= fd;
+  snprintf(path, sizeof(path), "%s/%016llx%016llx", cache.dir,
+	   (unsigned long long)cache.hash[0], (unsigned long long)cache.hash[1]);
+  cacheReplay(path);
+  cacheRecord(path);
+}
+
+
+static int doCache(int argc, char **argv, M6502 *mpu)	/* -C dir */
+{
+  if (argc < 2) usage(1);
+  cache.dir= argv[1];
+  return 1;
+}
@@ -0,0 +1,752 @@
+/* run6502_cc65.c -- native cc65 runtime helpers (-H)		-*- C -*- */
+
+/* Code compiled by cc65 spends much of its time in a handful of
+ * runtime subroutines: pushing and popping the soft stack, adjusting
+ * the soft stack pointer, shifting and multiplying ints.  With -H these
+ * are found in the loaded image and replaced by traps (see M6502_setTrap)
+ * that do the same work natively.
+ *
+ * The helpers are found either by name, from the label file written by
+ * 'ld65 -Ln', or (with '-H scan') by searching memory for their code.
+ * Either way the code at the address must match, byte for byte, the
+ * listing below; operands written 'sp', 'ptr1+1', ... are the runtime's
+ * zero-page variables, which must be the same in every helper, and
+ * '@name' is the address of another helper that must itself match.
+ * A helper whose code is different (another version of cc65, or a
+ * program that merely borrows the name) is left alone.
+ *
+ * Each native helper leaves the registers, flags, zero page, soft stack
+ * and the bytes below the hardware stack exactly as its listing would.
+ * When it cannot (decimal mode is set, the memory it touches is mapped
+ * to callbacks, or the listing takes a path that is not emulated) it
+ * declines and the 6502 code runs as usual.  The cycles the 6502 code
+ * would have taken are not counted, and breakpoints and watchpoints
+ * inside the helpers are not seen.
+ */
+
+enum { zpSp, zpSreg, zpPtr1, zpPtr2, zpPtr4, zpTmp1, zpCount };
+
+static const char *zpNames[zpCount]= { "sp", "sreg", "ptr1", "ptr2", "ptr4", "tmp1" };
+
+enum { hleN= 0x80, hleV= 0x40, hleD= 0x08, hleZ= 0x02, hleC= 0x01 };
+
+static struct
+{
+  const char	*labels;		/* ld65 label file, or "scan" */
+  int		 zp[zpCount];		/* address of each variable, -1 if unknown */
+} hle;
+
+typedef struct
+{
+  const char	 *name;
+  const char	 *code;
+  M6502_Trap	  trap;
+} Helper;
+
+#define hleWord(M, A)	((word)((M)[A] + ((M)[(A) + 1] << 8)))
+
+static void hleNZ(M6502_Registers *r, byte v)
+{
+  r->p= (r->p & ~(hleN | hleZ)) | (v & hleN) | (v ? 0 : hleZ);
+}
+
+
+/* true if none of the n bytes at addr is mapped to a callback */
+
+static int hlePlain(M6502 *mpu, word addr, unsigned n)
+{
+  while (n--)
+    {
+      if (mpu->callbacks->read[addr] || mpu->callbacks->write[addr])
+	return 0;
+      ++addr;
+    }
+  return 1;
+}
+
+/* the same for the n bytes at sp + offset */
+
+static int hleStack(M6502 *mpu, int offset, unsigned n)
+{
+  return hlePlain(mpu, hleWord(mpu->memory, hle.zp[zpSp]) + offset, n);
+}
+
+
+/* pushax:	pha
+ *		lda sp
+ *		sec
+ *		sbc #2
+ *		sta sp
+ *		bcs @L1
+ *		dec sp+1
+ *	@L1:	ldy #1
+ *		txa
+ *		sta (sp),y
+ *		pla
+ *		dey
+ *		sta (sp),y
+ *		rts
+ *
+ * push0 and pusha0 ('lda #0' and 'ldx #0') fall through into it.
+ */
+
+#define PUSHAX	"48 A5 sp 38 E9 02 85 sp B0 02 C6 sp+1 A0 01 8A 91 sp 68 88 91 sp 60"
+
+static int hlePush(M6502 *mpu, M6502_Registers *r, byte a, byte x)
+{
+  byte *m= mpu->memory;
+  int   sp= hle.zp[zpSp];
+  byte  lo= m[sp], res= lo - 2;
+  word  ea;
+  if ((r->p & hleD) || !hleStack(mpu, -2, 2)) return 0;
+  m[0x100 + r->s]= a;
+  m[sp]= res;
+  if (lo < 2) --m[sp + 1];
+  ea= hleWord(m, sp);
+  m[(word)(ea + 1)]= x;
+  m[ea]= a;
+  r->a= a;
+  r->x= x;
+  r->y= 0;
+  r->p= (r->p & ~(hleN | hleV | hleC)) | hleZ
+    | ((lo >= 2) ? hleC : 0) | (((lo ^ 2) & (lo ^ res) & 0x80) ? hleV : 0);
+  return 1;
+}
+
+static int hle_pushax(M6502 *mpu, word address, M6502_Registers *r)
+{
+  if (!hlePush(mpu, r, r->a, r->x)) return address;
+  return 0;
+}
+
+static int hle_pusha0(M6502 *mpu, word address, M6502_Registers *r)
+{
+  if (!hlePush(mpu, r, r->a, 0)) return address;
+  return 0;
+}
+
+static int hle_push0(M6502 *mpu, word address, M6502_Registers *r)
+{
+  if (!hlePush(mpu, r, 0, 0)) return address;
+  return 0;
+}
+
+
+/* pusha:	ldy sp
+ *		beq @L1
+ *		dec sp
+ *		ldy #0
+ *		sta (sp),y
+ *		rts
+ *	@L1:	dec sp+1
+ *		dec sp
+ *		sta (sp),y
+ *		rts
+ */
+
+#define PUSHA	"A4 sp F0 07 C6 sp A0 00 91 sp 60 C6 sp+1 C6 sp 91 sp 60"
+
+static int hle_pusha(M6502 *mpu, word address, M6502_Registers *r)
+{
+  byte *m= mpu->memory;
+  int   sp= hle.zp[zpSp];
+  if (!hleStack(mpu, -1, 1)) return address;
+  if (m[sp])
+    {
+      --m[sp];
+      r->p= (r->p & ~hleN) | hleZ;			/* ldy #0 */
+    }
+  else
+    {
+      --m[sp + 1];
+      m[sp]= 0xff;
+      r->p= (r->p & ~hleZ) | hleN;			/* dec sp */
+    }
+  m[hleWord(m, sp)]= r->a;
+  r->y= 0;
+  return 0;
+}
+
+
+/* incsp1:	inc sp
+ *		bne @L1
+ *		inc sp+1
+ *	@L1:	rts
+ */
+
+#define INCSP1	"E6 sp D0 02 E6 sp+1 60"
+
+static int hle_incsp1(M6502 *mpu, word address, M6502_Registers *r)
+{
+  byte *m= mpu->memory;
+  int   sp= hle.zp[zpSp];
+  if (++m[sp])
+    hleNZ(r, m[sp]);
+  else
+    hleNZ(r, ++m[sp + 1]);
+  return 0;
+}
+
+
+/* incsp2:	inc sp
+ *		beq @L1
+ *		inc sp
+ *		beq @L2
+ *		rts
+ *	@L1:	inc sp
+ *	@L2:	inc sp+1
+ *		rts
+ */
+
+#define INCSP2	"E6 sp F0 05 E6 sp F0 03 60 E6 sp E6 sp+1 60"
+
+static void hleIncsp2(M6502 *mpu, M6502_Registers *r)
+{
+  byte *m= mpu->memory;
+  int   sp= hle.zp[zpSp];
+  if (!++m[sp])
+    ++m[sp];
+  else if (++m[sp])
+    {
+      hleNZ(r, m[sp]);
+      return;
+    }
+  hleNZ(r, ++m[sp + 1]);
+}
+
+static int hle_incsp2(M6502 *mpu, word address, M6502_Registers *r)
+{
+  hleIncsp2(mpu, r);
+  return 0;
+}
+
+
+/* addysp1:	iny
+ * addysp:	pha
+ *		clc
+ *		tya
+ *		adc sp
+ *		sta sp
+ *		bcc @L1
+ *		inc sp+1
+ *	@L1:	pla
+ *		rts
+ *
+ * incsp3 to incsp8 are 'ldy #n' and 'jmp addysp'.
+ */
+
+#define ADDYSP	"48 18 98 65 sp 85 sp 90 02 E6 sp+1 68 60"
+
+static int hleAddysp(M6502 *mpu, M6502_Registers *r, byte y)
+{
+  byte	   *m= mpu->memory;
+  int	    sp= hle.zp[zpSp];
+  byte	    lo= m[sp];
+  unsigned  sum= lo + y;
+  if (r->p & hleD) return 0;
+  m[0x100 + r->s]= r->a;
+  m[sp]= sum;
+  if (sum > 0xff) ++m[sp + 1];
+  r->y= y;
+  hleNZ(r, r->a);
+  r->p= (r->p & ~(hleV | hleC)) | ((sum > 0xff) ? hleC : 0)
+    | ((~(lo ^ y) & (lo ^ sum) & 0x80) ? hleV : 0);
+  return 1;
+}
+
+static int hle_addysp(M6502 *mpu, word address, M6502_Registers *r)
+{
+  if (!hleAddysp(mpu, r, r->y)) return address;
+  return 0;
+}
+
+static int hle_addysp1(M6502 *mpu, word address, M6502_Registers *r)
+{
+  if (!hleAddysp(mpu, r, r->y + 1)) return address;
+  return 0;
+}
+
+#define hleIncsp(N)							\
+  static int hle_incsp##N(M6502 *mpu, word address, M6502_Registers *r)	\
+  {									\
+    if (!hleAddysp(mpu, r, N)) return address;				\
+    return 0;								\
+  }
+
+hleIncsp(3)
+hleIncsp(4)
+hleIncsp(5)
+hleIncsp(6)
+hleIncsp(7)
+hleIncsp(8)
+
+#undef hleIncsp
+
+
+/* aslax1:	stx tmp1
+ *		asl a
+ *		rol tmp1
+ *		ldx tmp1
+ *		rts
+ *
+ * and aslax2 to aslax4 with two to four 'asl a' and 'rol tmp1'.
+ * shlax1 to shlax4 are the same routines.
+ */
+
+#define ASL	" 0A 26 tmp1"
+#define ASLAX(SHIFTS)	"86 tmp1" SHIFTS " A6 tmp1 60"
+
+static void hleAslax(M6502 *mpu, M6502_Registers *r, int n)
+{
+  byte a= r->a, t= r->x, c= 0;
+  while (n--)
+    {
+      byte out= t >> 7;
+      t= (t << 1) | (a >> 7);
+      a <<= 1;
+      c= out;
+    }
+  mpu->memory[hle.zp[zpTmp1]]= t;
+  r->a= a;
+  r->x= t;
+  hleNZ(r, t);
+  r->p= (r->p & ~hleC) | c;
+}
+
+#define hleShift(N)							\
+  static int hle_aslax##N(M6502 *mpu, word address, M6502_Registers *r)	\
+  {									\
+    hleAslax(mpu, r, N);						\
+    return 0;								\
+  }
+
+hleShift(1)
+hleShift(2)
+hleShift(3)
+hleShift(4)
+
+#undef hleShift
+
+
+/* popsreg:	pha
+ *		ldy #1
+ *		lda (sp),y
+ *		sta sreg+1
+ *		dey
+ *		lda (sp),y
+ *		sta sreg
+ *		pla
+ *		jmp incsp2
+ */
+
+#define POPSREG	"48 A0 01 B1 sp 85 sreg+1 88 B1 sp 85 sreg 68 4C @incsp2"
+
+static void hlePopsreg(M6502 *mpu, M6502_Registers *r)
+{
+  byte *m= mpu->memory;
+  word  ea= hleWord(m, hle.zp[zpSp]);
+  m[0x100 + r->s]= r->a;
+  m[hle.zp[zpSreg] + 1]= m[(word)(ea + 1)];
+  m[hle.zp[zpSreg]]= m[ea];
+  r->y= 0;
+  hleIncsp2(mpu, r);
+}
+
+static int hle_popsreg(M6502 *mpu, word address, M6502_Registers *r)
+{
+  if (!hleStack(mpu, 0, 2)) return address;
+  hlePopsreg(mpu, r);
+  return 0;
+}
+
+
+/* tosmulax:	sta ptr4
+ *		txa
+ *		beq @L3			; 8x16, not emulated
+ *		stx ptr4+1
+ *		jsr popsreg
+ *		lda #0
+ *		ldx sreg+1
+ *		beq @L4			; 8x16, not emulated
+ *		sta tmp1
+ *		ldy #16
+ *		lsr ptr4+1
+ *		ror ptr4
+ *	@L0:	bcc @L1
+ *		clc
+ *		adc sreg
+ *		pha
+ *		txa
+ *		adc tmp1
+ *		sta tmp1
+ *		pla
+ *	@L1:	ror tmp1
+ *		ror a
+ *		ror ptr4+1
+ *		ror ptr4
+ *		dey
+ *		bne @L0
+ *		lda ptr4
+ *		ldx ptr4+1
+ *		rts
+ *
+ * tosumulax is the same routine.
+ */
+
+#define TOSMULAX "85 ptr4 8A F0 .. 86 ptr4+1 20 @popsreg A9 00 A6 sreg+1 F0 .. 85 tmp1 A0 10"	\
+		 " 46 ptr4+1 66 ptr4 90 0A 18 65 sreg 48 8A 65 tmp1 85 tmp1 68"		\
+		 " 66 tmp1 6A 66 ptr4+1 66 ptr4 88 D0 EA A5 ptr4 A6 ptr4+1 60"
+
+#define hleRor(V, C)	{ byte out= (V) & 1;  (V)= ((V) >> 1) | ((C) << 7);  (C)= out; }
+
+static int hle_tosmulax(M6502 *mpu, word address, M6502_Registers *r)
+{
+  byte *m= mpu->memory;
+  int   ptr4= hle.zp[zpPtr4], sreg= hle.zp[zpSreg], tmp1= hle.zp[zpTmp1];
+  word  ret= address + 9;
+  byte  a, x, c, v, y;
+  if ((r->p & hleD) || !r->x || !hleStack(mpu, 0, 2)
+      || !m[(word)(hleWord(m, hle.zp[zpSp]) + 1)])
+    return address;
+  m[ptr4]= r->a;
+  m[ptr4 + 1]= r->a= r->x;
+  m[0x100 + r->s]= ret >> 8;				/* jsr popsreg */
+  m[0x100 + (byte)(r->s - 1)]= ret;
+  r->s -= 2;
+  hlePopsreg(mpu, r);
+  r->s += 2;
+  a= 0;
+  x= m[sreg + 1];
+  m[tmp1]= 0;
+  c= m[ptr4 + 1] & 1;
+  m[ptr4 + 1] >>= 1;
+  hleRor(m[ptr4], c);
+  v= r->p & hleV;
+  for (y= 16;  y;  --y)
+    {
+      if (c)
+	{
+	  unsigned sum= a + m[sreg];
+	  v= (~(a ^ m[sreg]) & (a ^ sum) & 0x80) ? hleV : 0;
+	  a= sum;
+	  m[0x100 + r->s]= a;
+	  sum= x + m[tmp1] + (sum > 0xff);
+	  v= (~(x ^ m[tmp1]) & (x ^ sum) & 0x80) ? hleV : 0;
+	  m[tmp1]= sum;
+	  c= sum > 0xff;
+	}
+      hleRor(m[tmp1], c);
+      hleRor(a, c);
+      hleRor(m[ptr4 + 1], c);
+      hleRor(m[ptr4], c);
+    }
+  r->a= m[ptr4];
+  r->x= m[ptr4 + 1];
+  r->y= 0;
+  hleNZ(r, r->x);
+  r->p= (r->p & ~(hleV | hleC)) | v | c;
+  return 0;
+}
+
+#undef hleRor
+
+
+/* zerobss:	lda #<__BSS_RUN__
+ *		sta ptr1
+ *		lda #>__BSS_RUN__
+ *		sta ptr1+1
+ *		lda #0
+ *		tay
+ *		ldx #>__BSS_SIZE__
+ *		beq L3
+ *	L2:	sta (ptr1),y
+ *		iny
+ *		bne L2
+ *		inc ptr1+1
+ *		dex
+ *		bne L2
+ *	L3:	cpy #<__BSS_SIZE__
+ *		beq L4
+ *		sta (ptr1),y
+ *		iny
+ *		bne L3
+ *	L4:	rts
+ */
+
+#define ZEROBSS	"A9 .. 85 ptr1 A9 .. 85 ptr1+1 A9 00 A8 A2 .. F0 0A 91 ptr1 C8 D0 FB"	\
+		" E6 ptr1+1 CA D0 F6 C0 .. F0 05 91 ptr1 C8 D0 F7 60"
+
+static int hle_zerobss(M6502 *mpu, word address, M6502_Registers *r)
+{
+  byte *m= mpu->memory;
+  int   ptr1= hle.zp[zpPtr1];
+  word  bss= m[(word)(address + 1)] | (m[(word)(address + 5)] << 8);
+  byte  pages= m[(word)(address + 12)], rest= m[(word)(address + 26)];
+  word	ea;
+  if (!hlePlain(mpu, bss, (pages << 8) | rest)) return address;
+  for (ea= 0;  ea < ((pages << 8) | rest);  ++ea)
+    m[(word)(bss + ea)]= 0;
+  m[ptr1]= bss;
+  m[ptr1 + 1]= (bss >> 8) + pages;
+  r->a= r->x= 0;
+  r->y= rest;
+  r->p= (r->p & ~hleN) | hleZ | hleC;
+  return 0;
+}
+
+
+/* copydata:	lda #<__DATA_LOAD__
+ *		sta ptr1
+ *		lda #>__DATA_LOAD__
+ *		sta ptr1+1
+ *		lda #<__DATA_RUN__
+ *		sta ptr2
+ *		lda #>__DATA_RUN__
+ *		sta ptr2+1
+ *		ldx #<~__DATA_SIZE__
+ *		lda #>~__DATA_SIZE__
+ *		sta tmp1
+ *		ldy #$00
+ *	@L1:	inx
+ *		beq @L3
+ *	@L2:	lda (ptr1),y
+ *		sta (ptr2),y
+ *		iny
+ *		bne @L1
+ *		inc ptr1+1
+ *		inc ptr2+1
+ *		bne @L1
+ *	@L3:	inc tmp1
+ *		bne @L2
+ *		rts
+ */
+
+#define COPYDATA "A9 .. 85 ptr1 A9 .. 85 ptr1+1 A9 .. 85 ptr2 A9 .. 85 ptr2+1 A2 .. A9 .. 85 tmp1"	\
+		 " A0 00 E8 F0 0D B1 ptr1 91 ptr2 C8 D0 F6 E6 ptr1+1 E6 ptr2+1 D0 F0 E6 tmp1 D0 EF 60"
+
+static int hle_copydata(M6502 *mpu, word address, M6502_Registers *r)
+{
+  byte *m= mpu->memory;
+  int   ptr1= hle.zp[zpPtr1], ptr2= hle.zp[zpPtr2], tmp1= hle.zp[zpTmp1];
+  word  load= m[(word)(address + 1)] | (m[(word)(address + 5)] << 8);
+  word  run=  m[(word)(address + 9)] | (m[(word)(address + 13)] << 8);
+  word  size= ~(m[(word)(address + 17)] | (m[(word)(address + 19)] << 8));
+  byte  a, x, y;
+  if (!hlePlain(mpu, load, size) || !hlePlain(mpu, run, size)) return address;
+  m[ptr1]= load;  m[ptr1 + 1]= load >> 8;
+  m[ptr2]= run;   m[ptr2 + 1]= run >> 8;
+  x= m[(word)(address + 17)];
+  m[tmp1]= a= m[(word)(address + 19)];
+  y= 0;
+  for (;;)		/* exactly as the 6502 code, including its pointers wrapping */
+    {
+      if (!++x) goto l3;
+    l2:
+      a= m[(word)(hleWord(m, ptr1) + y)];
+      m[(word)(hleWord(m, ptr2) + y)]= a;
+      if (++y) continue;
+      ++m[ptr1 + 1];
+      if (++m[ptr2 + 1]) continue;
+    l3:
+      if (++m[tmp1]) goto l2;
+      break;
+    }
+  r->a= a;
+  r->x= x;
+  r->y= y;
+  r->p= (r->p & ~hleN) | hleZ;
+  return 0;
+}
+
+
+static const Helper helpers[]=
+{
+  { "push0",	 "A9 00 A2 00 " PUSHAX,		hle_push0    },
+  { "pusha0",	 "A2 00 " PUSHAX,		hle_pusha0   },
+  { "pushax",	 PUSHAX,			hle_pushax   },
+  { "pusha",	 PUSHA,				hle_pusha    },
+  { "incsp1",	 INCSP1,			hle_incsp1   },
+  { "incsp2",	 INCSP2,			hle_incsp2   },
+  { "addysp1",	 "C8 " ADDYSP,			hle_addysp1  },
+  { "addysp",	 ADDYSP,			hle_addysp   },
+  { "incsp3",	 "A0 03 4C @addysp",		hle_incsp3   },
+  { "incsp4",	 "A0 04 4C @addysp",		hle_incsp4   },
+  { "incsp5",	 "A0 05 4C @addysp",		hle_incsp5   },
+  { "incsp6",	 "A0 06 4C @addysp",		hle_incsp6   },
+  { "incsp7",	 "A0 07 4C @addysp",		hle_incsp7   },
+  { "incsp8",	 "A0 08 4C @addysp",		hle_incsp8   },
+  { "aslax1",	 ASLAX(ASL),			hle_aslax1   },
+  { "aslax2",	 ASLAX(ASL ASL),		hle_aslax2   },
+  { "aslax3",	 ASLAX(ASL ASL ASL),		hle_aslax3   },
+  { "aslax4",	 ASLAX(ASL ASL ASL ASL),	hle_aslax4   },
+  { "shlax1",	 ASLAX(ASL),			hle_aslax1   },
+  { "shlax2",	 ASLAX(ASL ASL),		hle_aslax2   },
+  { "shlax3",	 ASLAX(ASL ASL ASL),		hle_aslax3   },
+  { "shlax4",	 ASLAX(ASL ASL ASL ASL),	hle_aslax4   },
+  { "popsreg",	 POPSREG,			hle_popsreg  },
+  { "tosmulax",	 TOSMULAX,			hle_tosmulax },
+  { "tosumulax", TOSMULAX,			hle_tosmulax },
+  { "zerobss",	 ZEROBSS,			hle_zerobss  },
+  { "copydata",	 COPYDATA,			hle_copydata },
+  { 0, 0, 0 }
+};
+
+#undef PUSHAX
+#undef PUSHA
+#undef INCSP1
+#undef INCSP2
+#undef ADDYSP
+#undef ASL
+#undef ASLAX
+#undef POPSREG
+#undef TOSMULAX
+#undef ZEROBSS
+#undef COPYDATA
+
+
+static const Helper *hleFind(const char *name, int length)
+{
+  const Helper *h;
+  for (h= helpers;  h->name;  ++h)
+    if ((int)strlen(h->name) == length && !strncmp(h->name, name, length))
+      return h;
+  return 0;
+}
+
+
+/* answers whether the code at addr is the helper's listing, binding
+ * the zero-page variables in zp as it goes.
+ */
+
+static int hleMatch(M6502 *mpu, const Helper *h, word addr, int *zp, int depth)
+{
+  const byte *m= mpu->memory;
+  const char *p= h->code;
+  while (*p)
+    {
+      int n= 0;
+      if (' ' == *p)
+	++p;
+      else if ('.' == *p)
+	{
+	  p += 2;
+	  ++addr;
+	}
+      else if ('@' == *p)
+	{
+	  const Helper *g;
+	  while (isalnum(p[1 + n])) ++n;
+	  if (!(g= hleFind(p + 1, n)) || (depth > 2)
+	      || !hleMatch(mpu, g, m[addr] | (m[(word)(addr + 1)] << 8), zp, depth + 1))
+	    return 0;
+	  p += 1 + n;
+	  addr += 2;
+	}
+      else if (isupper(*p) || isdigit(*p))
+	{
+	  if (m[addr++] != strtol((char[]){ p[0], p[1], 0 }, 0, 16))
+	    return 0;
+	  p += 2;
+	}
+      else
+	{
+	  int i, offset= 0;
+	  while (isalnum(p[n])) ++n;
+	  for (i= 0;  (i < zpCount) && ((int)strlen(zpNames[i]) != n || strncmp(zpNames[i], p, n));  ++i)
+	    ;
+	  if (i == zpCount) fail("-H: bad listing for %s", h->name);
+	  p += n;
+	  if ('+' == *p)
+	    {
+	      offset= p[1] - '0';
+	      p += 2;
+	    }
+	  if (m[addr] < offset)
+	    return 0;
+	  if (zp[i] < 0)
+	    zp[i]= m[addr] - offset;
+	  else if (zp[i] != m[addr] - offset)
+	    return 0;
+	  ++addr;
+	}
+    }
+  return 1;
+}
+
+
+static int hleInstall(M6502 *mpu, const Helper *h, word addr)
+{
+  int zp[zpCount];
+  memcpy(zp, hle.zp, sizeof(zp));
+  if ((M6502_getCallback(mpu, call, addr) && (M6502_getTrap(mpu, addr) != h->trap))
+      || !hleMatch(mpu, h, addr, zp, 0))
+    return 0;
+  memcpy(hle.zp, zp, sizeof(zp));
+  M6502_setTrap(mpu, addr, h->trap);
+  return 1;
+}
+
+
+/* called once the image is loaded */
+
+static void hleStart(M6502 *mpu)
+{
+  const Helper *h;
+  int		i, found= 0;
+
+  for (i= 0;  i < zpCount;  ++i)
+    hle.zp[i]= -1;
+
+  if (!strcmp(hle.labels, "scan"))
+    for (h= helpers;  h->name;  ++h)
+      {
+	unsigned addr;
+	for (addr= 0;  addr < 0x10000;  ++addr)
+	  found += hleInstall(mpu, h, addr);
+      }
+  else
+    {
+      struct { const Helper *h; word addr; } named[sizeof(helpers) / sizeof(*helpers)];
+      int   count= 0;
+      char  line[256];
+      FILE *in= fopen(hle.labels, "r");
+      if (!in) pfail(hle.labels);
+      while (fgets(line, sizeof(line), in))		/* al 000803 .pushax */
+	{
+	  unsigned addr;
+	  char     name[64];
+	  if (2 != sscanf(line, "al %x .%63s", &addr, name))
+	    continue;
+	  for (i= 0;  i < zpCount;  ++i)
+	    if (!strcmp(name, zpNames[i]))
+	      hle.zp[i]= addr;
+	  if ((h= hleFind(name, strlen(name))) && (count < (int)(sizeof(named) / sizeof(*named))))
+	    {
+	      named[count].h= h;
+	      named[count++].addr= addr;
+	    }
+	}
+      fclose(in);
+      for (i= 0;  i < count;  ++i)
+	if (hleInstall(mpu, named[i].h, named[i].addr))
+	  ++found;
+	else
+	  fprintf(stderr, "%s: %s at %04X is not the expected code: not emulated\n",
+		  program, named[i].h->name, named[i].addr);
+    }
+
+  for (i= 0;  i < zpCount;  ++i)
+    if ((hle.zp[i] >= 0) && !hlePlain(mpu, hle.zp[i], 2))
+      fail("-H: %s (%04X) is mapped to a callback", zpNames[i], hle.zp[i]);
+
+  if (!found)
+    fprintf(stderr, "%s: no cc65 runtime helpers found\n", program);
+}
+
+
+static int doHle(int argc, char **argv, M6502 *mpu)	/* -H labels */
+{
+  if (argc < 2) usage(1);
+  hle.labels= argv[1];
+  return 1;
+}
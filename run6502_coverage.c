@@ -0,0 +1,282 @@
+/* run6502_coverage.c -- source line coverage (--coverage)	-*- C -*- */
+
+/* With --coverage dbgfile file the processor sets a bit for the
+ * address of every instruction it executes (see M6502_setCoverage) and
+ * when the emulation ends the bitmap is mapped through the line and
+ * span records of the debug information written by 'ld65 --dbgfile'.
+ * A source line that produced code is covered if any instruction in
+ * its spans was executed.  Every line the debug file knows about is
+ * reported, C and assembler alike, including those of the runtime
+ * library if it was assembled with debug information.
+ *
+ * The result is written to the file in the lcov tracefile format
+ * (SF:, DA:, LF:, LH:, end_of_record), merged with whatever the file
+ * already holds: the count for each line is the number of runs that
+ * executed it.  The file is locked while it is being updated, so any
+ * number of runs (for example, a test suite run in parallel) can share
+ * one file.  Spans of data (those with a type) are not counted as
+ * code.  Runs with --coverage are not cached.
+ */
+
+#include <sys/file.h>
+
+static struct
+{
+  const char	*dbg;		/* ld65 --dbgfile */
+  const char	*path;		/* lcov tracefile */
+  M6502		*mpu;		/* until it is written */
+  uint8_t	 bitmap[0x10000 / 8];
+  char	       **files;		/* [file id] */
+  int		 nfiles;
+  struct { int seg;  word start, size;  int data; } *spans;	/* [span id] */
+  int		 nspans;
+  unsigned	*segs;		/* [seg id] start address */
+  int		 nsegs;
+  struct { int file;  unsigned line, first, count; } *lines;	/* with spans */
+  int		 nlines;
+  int		*spanIds;	/* lines[i].count from lines[i].first */
+  int		 nspanIds;
+} coverage;
+
+typedef struct
+{
+  const char	*file;
+  unsigned	 line;
+  unsigned long	 count;
+} CoverageLine;
+
+
+/* make room for array[index], zeroing any new elements */
+
+static void *coverageGrow(void *array, int *size, int index, size_t elem)
+{
+  int n= *size;
+  if (index < n)
+    return array;
+  while (n <= index) n= n ? 2 * n : 64;
+  if (!(array= realloc(array, n * elem))) fail("out of memory");
+  memset((char *)array + *size * elem, 0, (n - *size) * elem);
+  *size= n;
+  return array;
+}
+
+
+/* the value of 'key=' in a record, or 0 */
+
+static const char *coverageField(const char *record, const char *key)
+{
+  size_t      len= strlen(key);
+  const char *p;
+  for (p= record + 1;  (p= strstr(p, key));  p += len)
+    if (((p[-1] == '\t') || (p[-1] == ',')) && (p[len] == '='))
+      return p + len + 1;
+  return 0;
+}
+
+
+static long coverageNumber(const char *record, const char *key, long otherwise)
+{
+  const char *value= coverageField(record, key);
+  return value ? strtol(value, 0, 0) : otherwise;
+}
+
+
+static void coverageRead(void)
+{
+  FILE	 *in;
+  char	 *record= 0;
+  size_t  size= 0;
+  int	  nfiles= 0, nspans= 0, nsegs= 0, nlines= 0, nspanIds= 0;
+  long	  id;
+
+  if (!(in= fopen(coverage.dbg, "r"))) pfail(coverage.dbg);
+  while (getline(&record, &size, in) > 0)
+    {
+      const char *value;
+      if ((id= coverageNumber(record, "id", -1)) < 0)
+	continue;
+      if (!strncmp(record, "file\t", 5) && (value= coverageField(record, "name")) && ('"' == *value++))
+	{
+	  coverage.files= coverageGrow(coverage.files, &nfiles, id, sizeof(char *));
+	  coverage.files[id]= strndup(value, strcspn(value, "\""));
+	  if (id >= coverage.nfiles) coverage.nfiles= id + 1;
+	}
+      else if (!strncmp(record, "seg\t", 4))
+	{
+	  coverage.segs= coverageGrow(coverage.segs, &nsegs, id, sizeof(unsigned));
+	  coverage.segs[id]= coverageNumber(record, "start", 0);
+	  if (id >= coverage.nsegs) coverage.nsegs= id + 1;
+	}
+      else if (!strncmp(record, "span\t", 5))
+	{
+	  coverage.spans= coverageGrow(coverage.spans, &nspans, id, sizeof(*coverage.spans));
+	  coverage.spans[id].seg=   coverageNumber(record, "seg", -1);
+	  coverage.spans[id].start= coverageNumber(record, "start", 0);
+	  coverage.spans[id].size=  coverageNumber(record, "size", 0);
+	  coverage.spans[id].data=  !!coverageField(record, "type");
+	  if (id >= coverage.nspans) coverage.nspans= id + 1;
+	}
+      else if (!strncmp(record, "line\t", 5) && (value= coverageField(record, "span")))
+	{								/* span=3+4+5 */
+	  int n= coverage.nlines;
+	  coverage.lines= coverageGrow(coverage.lines, &nlines, n, sizeof(*coverage.lines));
+	  coverage.lines[n].file=  coverageNumber(record, "file", -1);
+	  coverage.lines[n].line=  coverageNumber(record, "line", 0);
+	  coverage.lines[n].first= coverage.nspanIds;
+	  for (;;)
+	    {
+	      char *end;
+	      long  span= strtol(value, &end, 0);
+	      if (end == value)
+		break;
+	      coverage.spanIds= coverageGrow(coverage.spanIds, &nspanIds, coverage.nspanIds, sizeof(int));
+	      coverage.spanIds[coverage.nspanIds++]= span;
+	      if ('+' != *end)
+		break;
+	      value= end + 1;
+	    }
+	  coverage.lines[n].count= coverage.nspanIds - coverage.lines[n].first;
+	  coverage.nlines= n + 1;
+	}
+    }
+  free(record);
+  fclose(in);
+}
+
+
+/* -1 if the line produced no code, otherwise whether any of it ran */
+
+static int coverageHit(int line)
+{
+  int code= 0, i;
+
+  for (i= 0;  i < (int)coverage.lines[line].count;  ++i)
+    {
+      int id= coverage.spanIds[coverage.lines[line].first + i];
+      unsigned addr, start;
+      if ((id < 0) || (id >= coverage.nspans) || coverage.spans[id].data
+	  || (coverage.spans[id].seg < 0) || (coverage.spans[id].seg >= coverage.nsegs))
+	continue;
+      code= 1;
+      start= coverage.segs[coverage.spans[id].seg] + coverage.spans[id].start;
+      for (addr= start;  addr < start + coverage.spans[id].size;  ++addr)
+	if (coverage.bitmap[(addr >> 3) & 0x1FFF] & (1 << (addr & 7)))
+	  return 1;
+    }
+  return code ? 0 : -1;
+}
+
+
+static int coverageOrder(const void *a, const void *b)
+{
+  const CoverageLine *p= a, *q= b;
+  int order= strcmp(p->file, q->file);
+  if (order) return order;
+  return (p->line > q->line) - (p->line < q->line);
+}
+
+
+/* sort the lines and combine those that are the same, by adding their
+ * counts or (when merging the records of one run) taking the larger */
+
+static int coverageCombine(CoverageLine *lines, int n, int add)
+{
+  int i, m= 0;
+
+  qsort(lines, n, sizeof(CoverageLine), coverageOrder);
+  for (i= 0;  i < n;  ++i)
+    if (m && !coverageOrder(&lines[m - 1], &lines[i]))
+      {
+	if (add)
+	  lines[m - 1].count += lines[i].count;
+	else if (lines[i].count > lines[m - 1].count)
+	  lines[m - 1].count= lines[i].count;
+      }
+    else
+      lines[m++]= lines[i];
+  return m;
+}
+
+
+static void coverageWrite(void)
+{
+  CoverageLine *lines= 0;
+  int		size= 0, n= 0, i, fd, hit;
+  char	       *record= 0, *file= 0;
+  size_t	length= 0;
+  FILE	       *out;
+
+  if (!coverage.mpu)
+    return;
+  M6502_setCoverage(coverage.mpu, 0);
+  coverage.mpu= 0;
+
+  for (i= 0;  i < coverage.nlines;  ++i)
+    if ((coverage.lines[i].file >= 0) && (coverage.lines[i].file < coverage.nfiles)
+	&& coverage.files[coverage.lines[i].file] && ((hit= coverageHit(i)) >= 0))
+      {
+	lines= coverageGrow(lines, &size, n, sizeof(CoverageLine));
+	lines[n].file=  coverage.files[coverage.lines[i].file];
+	lines[n].line=  coverage.lines[i].line;
+	lines[n++].count= hit;
+      }
+  n= coverageCombine(lines, n, 0);
+
+  if ((fd= open(coverage.path, O_RDWR | O_CREAT, 0666)) < 0) pfail(coverage.path);
+  flock(fd, LOCK_EX);
+  if (!(out= fdopen(fd, "r+"))) pfail(coverage.path);
+  while (getline(&record, &length, out) > 0)		/* merge the earlier runs */
+    {
+      unsigned      line;
+      unsigned long count;
+      if (!strncmp(record, "SF:", 3))
+	{
+	  free(file);
+	  file= strndup(record + 3, strcspn(record + 3, "\r\n"));
+	}
+      else if (file && (2 == sscanf(record, "DA:%u,%lu", &line, &count)))
+	{
+	  lines= coverageGrow(lines, &size, n, sizeof(CoverageLine));
+	  lines[n].file= strdup(file);		/* never freed */
+	  lines[n].line= line;
+	  lines[n++].count= count;
+	}
+    }
+  free(record);
+  free(file);
+  n= coverageCombine(lines, n, 1);
+
+  rewind(out);
+  if (ftruncate(fd, 0)) pfail(coverage.path);
+  for (i= 0;  i < n;  )
+    {
+      int first= i, covered= 0;
+      fprintf(out, "TN:\nSF:%s\n", lines[i].file);
+      for (;  (i < n) && !strcmp(lines[i].file, lines[first].file);  ++i)
+	{
+	  fprintf(out, "DA:%u,%lu\n", lines[i].line, lines[i].count);
+	  covered += !!lines[i].count;
+	}
+      fprintf(out, "LF:%d\nLH:%d\nend_of_record\n", i - first, covered);
+    }
+  if (fclose(out)) pfail(coverage.path);		/* and unlock */
+  free(lines);
+}
+
+
+static void coverageStart(M6502 *mpu)
+{
+  coverageRead();
+  M6502_setCoverage(mpu, coverage.bitmap);
+  coverage.mpu= mpu;
+  atexit(coverageWrite);	/* -X and friends exit from inside the emulation */
+}
+
+
+static int doCoverage(int argc, char **argv, M6502 *mpu)	/* --coverage dbgfile file */
+{
+  if (argc < 3) usage(1);
+  coverage.dbg=  argv[1];
+  coverage.path= argv[2];
+  return 2;
+}
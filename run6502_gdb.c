@@ -0,0 +1,464 @@
+/* run6502_gdb.c -- GDB remote serial protocol stub		-*- C -*- */
+
+/* 'run6502 -g address' waits for a debugger to connect to address
+ * (a Unix-domain socket if it contains a '/', otherwise [host]:port on
+ * the loopback interface) and then lets it drive the processor:
+ *
+ *	(gdb) set architecture ...		(any; or none)
+ *	(gdb) target remote :1234
+ *
+ * The registers are described to the debugger with a target
+ * description (a, x, y, s, p: 8 bits; pc: 16 bits) so no 6502 support
+ * is needed in GDB itself.  Software breakpoints and watchpoints are
+ * the lib6502 ones (see M6502_setBreakpoint); between them the guest
+ * runs in the normal engine at full speed.  While the guest runs the
+ * connection is checked for an interrupt request (^C) every
+ * GDB_POLL cycles from a scheduled event.
+ */
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+
+#define GDB_PACKET	4096
+#define GDB_POLL	100000	/* cycles */
+#define GDB_POINTS	64
+
+static struct
+{
+  char	*address;		/* -g argument, or 0 */
+  int	 fd;			/* connection to the debugger */
+  int	 interrupted;
+  struct { int type;  word addr;  int id; } points[GDB_POINTS];
+} gdb= { 0, -1 };
+
+static const char gdbTarget[]=
+  "<?xml version=\"1.0\"?>"
+  "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+  "<target version=\"1.0\">"
+  "<feature name=\"org.piumarta.lib6502\">"
+  "<reg name=\"a\"  bitsize=\"8\"  regnum=\"0\" type=\"uint8\"/>"
+  "<reg name=\"x\"  bitsize=\"8\"  regnum=\"1\" type=\"uint8\"/>"
+  "<reg name=\"y\"  bitsize=\"8\"  regnum=\"2\" type=\"uint8\"/>"
+  "<reg name=\"s\"  bitsize=\"8\"  regnum=\"3\" type=\"uint8\"/>"
+  "<reg name=\"p\"  bitsize=\"8\"  regnum=\"4\" type=\"uint8\"/>"
+  "<reg name=\"pc\" bitsize=\"16\" regnum=\"5\" type=\"code_ptr\"/>"
+  "</feature>"
+  "</target>";
+
+
+static int gdbListen(const char *address)
+{
+  int fd, conn, one= 1;
+
+  if (strchr(address, '/'))
+    {
+      struct sockaddr_un sun;
+      memset(&sun, 0, sizeof(sun));
+      sun.sun_family= AF_UNIX;
+      if (strlen(address) >= sizeof(sun.sun_path)) fail("%s: socket path too long", address);
+      strcpy(sun.sun_path, address);
+      unlink(address);
+      if (((fd= socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+	  || bind(fd, (struct sockaddr *)&sun, sizeof(sun)) || listen(fd, 1))
+	pfail(address);
+    }
+  else
+    {
+      struct sockaddr_in sin;
+      const char *port= strrchr(address, ':');
+      memset(&sin, 0, sizeof(sin));
+      sin.sin_family= AF_INET;
+      sin.sin_addr.s_addr= htonl(INADDR_LOOPBACK);
+      sin.sin_port= htons(atoi(port ? port + 1 : address));
+      if (((fd= socket(AF_INET, SOCK_STREAM, 0)) < 0)
+	  || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one))
+	  || bind(fd, (struct sockaddr *)&sin, sizeof(sin)) || listen(fd, 1))
+	pfail(address);
+    }
+  fprintf(stderr, "waiting for debugger on %s\n", address);
+  if ((conn= accept(fd, 0, 0)) < 0) pfail("accept");
+  setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));	/* fails harmlessly on AF_UNIX */
+  close(fd);
+  if (strchr(address, '/')) unlink(address);
+  return conn;
+}
+
+
+static int gdbGetChar(void)
+{
+  unsigned char c;
+  return (1 == read(gdb.fd, &c, 1)) ? c : EOF;
+}
+
+
+static void gdbWrite(const char *data, size_t size)
+{
+  while (size)
+    {
+      ssize_t n= write(gdb.fd, data, size);
+      if (n <= 0)
+	{
+	  if ((n < 0) && (EINTR == errno)) continue;
+	  exit(0);	/* debugger went away */
+	}
+      data += n;
+      size -= n;
+    }
+}
+
+
+/* answers the length of the next packet (acknowledged and without its
+ * framing) read into buffer, or -1 if the connection closed.  a lone
+ * ^C is returned as the packet "\003". */
+
+static int gdbReceive(char *buffer)
+{
+  for (;;)
+    {
+      int c, size= 0, sum= 0, check;
+      char hex[3]= { 0, 0, 0 };
+      while ('$' != (c= gdbGetChar()))
+	{
+	  if (EOF == c) return -1;
+	  if (3 == c)
+	    {
+	      strcpy(buffer, "\003");
+	      return 1;
+	    }
+	}
+      while ('#' != (c= gdbGetChar()))
+	{
+	  if (EOF == c) return -1;
+	  if (size < GDB_PACKET - 1) buffer[size++]= c;
+	  sum += c;
+	}
+      if ((EOF == (hex[0]= gdbGetChar())) || (EOF == (hex[1]= gdbGetChar()))) return -1;
+      check= strtol(hex, 0, 16);
+      buffer[size]= '\0';
+      if (check == (sum & 0xff))
+	{
+	  gdbWrite("+", 1);
+	  return size;
+	}
+      gdbWrite("-", 1);
+    }
+}
+
+
+static void gdbSend(const char *data)
+{
+  static char packet[GDB_PACKET + 5];	/* $, data, #, checksum, NUL */
+  int size= strlen(data), sum= 0, i;
+  packet[0]= '$';
+  for (i= 0;  i < size;  ++i)
+    sum += (packet[i + 1]= data[i]) & 0xff;
+  sprintf(packet + size + 1, "#%02x", sum & 0xff);
+  gdbWrite(packet, size + 4);
+  /* acknowledgement ('+') is consumed by the next gdbReceive() */
+}
+
+
+static void gdbHex(char *out, const byte *in, int size)
+{
+  while (size--)
+    out += sprintf(out, "%02x", *in++);
+  *out= '\0';
+}
+
+
+static int gdbUnhex(byte *out, const char *in, int size)
+{
+  while (size--)
+    {
+      unsigned v;
+      if (1 != sscanf(in, "%2x", &v)) return 0;
+      *out++= v;
+      in += 2;
+    }
+  return 1;
+}
+
+
+static void gdbRegisters(M6502 *mpu, char *reply)
+{
+  M6502_Registers *r= mpu->registers;
+  byte regs[7]= { r->a, r->x, r->y, r->s, r->p, r->pc & 0xff, r->pc >> 8 };
+  gdbHex(reply, regs, sizeof(regs));
+}
+
+
+static int gdbSetRegister(M6502 *mpu, int n, const char *hex)
+{
+  byte v[2];
+  M6502_Registers *r= mpu->registers;
+  if (!gdbUnhex(v, hex, (5 == n) ? 2 : 1)) return 0;
+  switch (n)
+    {
+    case 0:  r->a= v[0];  break;
+    case 1:  r->x= v[0];  break;
+    case 2:  r->y= v[0];  break;
+    case 3:  r->s= v[0];  break;
+    case 4:  r->p= v[0];  break;
+    case 5:  r->pc= v[0] | (v[1] << 8);  break;
+    default: return 0;
+    }
+  return 1;
+}
+
+
+/* Z/z packets: type 0,1 breakpoint, 2 write, 3 read, 4 access watchpoint */
+
+static int gdbPoint(M6502 *mpu, int insert, int type, unsigned addr, unsigned kind)
+{
+  static int access[]= { M6502_Break, M6502_Break, M6502_WatchWrite, M6502_WatchRead, M6502_WatchRead | M6502_WatchWrite };
+  int i, slot= -1;
+  if ((type < 0) || (type > 4)) return 0;
+  for (i= 0;  i < GDB_POINTS;  ++i)
+    if (!gdb.points[i].id)
+      {
+	if (slot < 0) slot= i;
+      }
+    else if ((gdb.points[i].type == type) && (gdb.points[i].addr == addr))
+      {
+	if (insert) return 1;
+	M6502_clearBreakpoint(mpu, gdb.points[i].id);
+	gdb.points[i].id= 0;
+	return 1;
+      }
+  if (!insert) return 1;
+  if (slot < 0) return 0;
+  if (type < 2)
+    gdb.points[slot].id= M6502_setBreakpoint(mpu, addr, 0);
+  else
+    gdb.points[slot].id= M6502_setWatchpoint(mpu, addr, addr + (kind ? kind : 1) - 1, access[type], 0);
+  gdb.points[slot].type= type;
+  gdb.points[slot].addr= addr;
+  return 0 != gdb.points[slot].id;
+}
+
+
+/* scheduled while the guest runs: stop it if the debugger sent ^C */
+
+static void gdbPoll(M6502 *mpu, uint64_t when, void *data)
+{
+  struct pollfd p= { gdb.fd, POLLIN, 0 };
+  if ((poll(&p, 1, 0) > 0) && (p.revents & POLLIN))
+    {
+      int c= gdbGetChar();
+      if ((3 == c) || (EOF == c))
+	{
+	  gdb.interrupted= 1;
+	  M6502_stop(mpu);
+	  return;
+	}
+    }
+  M6502_schedule(mpu, when + GDB_POLL, gdbPoll, 0);
+}
+
+
+/* the reason the processor last stopped, as a stop reply */
+
+static void gdbStopReply(M6502 *mpu, int ok, char *reply)
+{
+  int i, id= M6502_stopped(mpu, 0);
+  if (gdb.interrupted)
+    strcpy(reply, "S02");
+  else if (!ok)
+    strcpy(reply, "S04");	/* undefined instruction */
+  else
+    {
+      static const char *kind[]= { "", "", "watch", "rwatch", "awatch" };
+      strcpy(reply, "S05");
+      for (i= 0;  id && (i < GDB_POINTS);  ++i)
+	if ((gdb.points[i].id == id) && (gdb.points[i].type >= 2))
+	  sprintf(reply, "T05%s:%x;", kind[gdb.points[i].type], gdb.points[i].addr);
+    }
+  gdb.interrupted= 0;
+}
+
+
+static int gdbContinue(M6502 *mpu)
+{
+  M6502_schedule(mpu, mpu->cycles + GDB_POLL, gdbPoll, 0);
+  M6502_run(mpu);
+  M6502_cancel(mpu, gdbPoll, 0);
+  /* otherwise M6502_run returned on an undefined instruction */
+  return M6502_stopped(mpu, 0) || gdb.interrupted;
+}
+
+
+static void gdbExit(void)
+{
+  if (gdb.fd >= 0)
+    {
+      gdbSend("W00");
+      close(gdb.fd);
+      gdb.fd= -1;
+    }
+}
+
+
+static void gdbServe(M6502 *mpu)
+{
+  static char packet[GDB_PACKET], reply[GDB_PACKET + 1];
+  int ok= 1;
+
+  gdb.fd= gdbListen(gdb.address);
+  atexit(gdbExit);
+
+  for (;;)
+    {
+      char *args;
+      unsigned addr, size, i;
+
+      if (gdbReceive(packet) < 0)
+	break;
+      args= packet + 1;
+      reply[0]= '\0';
+
+      switch (packet[0])
+	{
+	case '?':
+	  gdbStopReply(mpu, ok, reply);
+	  break;
+
+	case 'g':
+	  gdbRegisters(mpu, reply);
+	  break;
+
+	case 'G':
+	  for (i= 0;  i < 6;  ++i)
+	    if (!gdbSetRegister(mpu, i, args + 2 * i)) break;
+	  strcpy(reply, (6 == i) ? "OK" : "E01");
+	  break;
+
+	case 'p':
+	  {
+	    char all[16];
+	    i= strtol(args, 0, 16);
+	    gdbRegisters(mpu, all);
+	    if (i < 5)		sprintf(reply, "%.2s", all + 2 * i);
+	    else if (5 == i)	strcpy(reply, all + 10);
+	    else		strcpy(reply, "E01");
+	    break;
+	  }
+
+	case 'P':
+	  strcpy(reply, (strchr(args, '=') && gdbSetRegister(mpu, strtol(args, 0, 16), strchr(args, '=') + 1)) ? "OK" : "E01");
+	  break;
+
+	case 'm':
+	  if ((2 != sscanf(args, "%x,%x", &addr, &size)) || (2 * size > GDB_PACKET))
+	    strcpy(reply, "E01");
+	  else
+	    for (i= 0;  i < size;  ++i)	/* byte by byte: addr + size may wrap */
+	      sprintf(reply + 2 * i, "%02x", mpu->memory[(word)(addr + i)]);
+	  break;
+
+	case 'M':
+	  if ((2 != sscanf(args, "%x,%x", &addr, &size)) || !strchr(args, ':'))
+	    strcpy(reply, "E01");
+	  else
+	    {
+	      char *hex= strchr(args, ':') + 1;
+	      for (i= 0;  i < size;  ++i)
+		if (!gdbUnhex(mpu->memory + (word)(addr + i), hex + 2 * i, 1)) break;
+	      strcpy(reply, (i == size) ? "OK" : "E01");
+	    }
+	  break;
+
+	case 'Z':
+	case 'z':
+	  {
+	    unsigned type, kind= 1;
+	    if (sscanf(args, "%x,%x,%x", &type, &addr, &kind) < 2)
+	      strcpy(reply, "E01");
+	    else if (type > 4)
+	      ;	/* unsupported: empty reply */
+	    else
+	      strcpy(reply, gdbPoint(mpu, 'Z' == packet[0], type, addr, kind) ? "OK" : "E01");
+	    break;
+	  }
+
+	case 's':
+	  if (*args) mpu->registers->pc= strtol(args, 0, 16);
+	  ok= M6502_step(mpu);
+	  gdbStopReply(mpu, ok, reply);
+	  break;
+
+	case 'c':
+	  if (*args) mpu->registers->pc= strtol(args, 0, 16);
+	  ok= gdbContinue(mpu);
+	  gdbStopReply(mpu, ok, reply);
+	  break;
+
+	case '\003':
+	  gdbStopReply(mpu, ok, reply);
+	  break;
+
+	case 'D':
+	  gdbSend("OK");
+	  close(gdb.fd);
+	  gdb.fd= -1;
+	  for (i= 0;  i < GDB_POINTS;  ++i)
+	    if (gdb.points[i].id) M6502_clearBreakpoint(mpu, gdb.points[i].id);
+	  M6502_run(mpu);
+	  return;
+
+	case 'k':
+	  close(gdb.fd);
+	  gdb.fd= -1;
+	  exit(0);
+
+	case 'H':
+	  strcpy(reply, "OK");
+	  break;
+
+	case 'q':
+	  if (!strncmp(packet, "qSupported", 10))
+	    sprintf(reply, "PacketSize=%x;qXfer:features:read+", GDB_PACKET - 1);	/* see gdbReceive() */
+	  else if (!strcmp(packet, "qAttached"))
+	    strcpy(reply, "1");
+	  else if (!strcmp(packet, "qC"))
+	    strcpy(reply, "QC1");
+	  else if (!strcmp(packet, "qfThreadInfo"))
+	    strcpy(reply, "m1");
+	  else if (!strcmp(packet, "qsThreadInfo"))
+	    strcpy(reply, "l");
+	  else if (!strncmp(packet, "qXfer:features:read:target.xml:", 31))
+	    {
+	      unsigned offset, length, total= sizeof(gdbTarget) - 1;
+	      if (2 != sscanf(packet + 31, "%x,%x", &offset, &length))
+		strcpy(reply, "E01");
+	      else
+		{
+		  if (offset > total) offset= total;
+		  if (length > GDB_PACKET - 2) length= GDB_PACKET - 2;
+		  if (length > total - offset) length= total - offset;
+		  reply[0]= (offset + length < total) ? 'm' : 'l';
+		  memcpy(reply + 1, gdbTarget + offset, length);
+		  reply[length + 1]= '\0';
+		}
+	    }
+	  break;
+
+	default:	/* not supported: empty reply */
+	  break;
+	}
+      gdbSend(reply);
+    }
+  close(gdb.fd);
+  gdb.fd= -1;
+}
+
+
+static int doGdb(int argc, char **argv, M6502 *mpu)	/* -g address */
+{
+  if (argc < 2) usage(1);
+  gdb.address= argv[1];
+  return 1;
+}
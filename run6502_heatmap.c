@@ -0,0 +1,179 @@
+/* run6502_heatmap.c -- memory access heatmap (--heatmap)		-*- C -*- */
+
+/* With --heatmap file[:n] the processor counts the reads, writes and
+ * instructions executed at every address (see M6502_setHeatmap) and
+ * when the emulation ends, for whatever reason, the file ('-' for
+ * stdout) is given:
+ *
+ *  - a map of the 256 pages of memory, one character per page, showing
+ *    how often each was accessed on a logarithmic scale;
+ *
+ *  - the reads, writes and executions in each page that was accessed;
+ *
+ *  - the n (20 by default) most frequently accessed addresses;
+ *
+ *  - the number of zero page bytes used and the highest of them, and
+ *    the lowest address in the stack page written (by pushes, JSR,
+ *    interrupts or stores), which is as deep as the stack went.
+ *
+ * Counting makes the emulation slower, and results are not cached.
+ */
+
+static struct
+{
+  const char	*path;
+  int		 top;		/* addresses listed */
+  M6502		*mpu;		/* until it is written */
+  M6502_Heatmap	*counts;
+} heatmap;
+
+typedef struct
+{
+  uint64_t	count;
+  word		addr;
+} HeatCount;
+
+
+static uint64_t heatTotal(int addr)
+{
+  return heatmap.counts->reads[addr] + heatmap.counts->writes[addr] + heatmap.counts->executes[addr];
+}
+
+
+static int heatBits(uint64_t n)
+{
+  int bits= 0;
+  while (n) { ++bits;  n >>= 1; }
+  return bits;
+}
+
+
+static int heatOrder(const void *a, const void *b)
+{
+  const HeatCount *p= a, *q= b;
+  if (p->count != q->count) return (p->count < q->count) ? 1 : -1;
+  return p->addr - q->addr;
+}
+
+
+static void heatmapWrite(void)
+{
+  static const char levels[]= " .:-=+*#%@";	/* none, then 1 to 9 */
+  M6502_Heatmap *h= heatmap.counts;
+  uint64_t	 pages[256], reads= 0, writes= 0, executes= 0, most= 0;
+  HeatCount	*hot;
+  FILE		*out;
+  int		 addr, page, i, n= 0, span, zpUsed= 0, zpHigh= -1, stackLow= -1;
+
+  if (!heatmap.mpu)
+    return;
+  M6502_setHeatmap(heatmap.mpu, 0);
+  heatmap.mpu= 0;
+
+  memset(pages, 0, sizeof(pages));
+  for (addr= 0;  addr < 0x10000;  ++addr)
+    {
+      reads    += h->reads[addr];
+      writes   += h->writes[addr];
+      executes += h->executes[addr];
+      pages[addr >> 8] += heatTotal(addr);
+    }
+  for (page= 0;  page < 256;  ++page)
+    if (pages[page] > most) most= pages[page];
+  span= heatBits(most) - 1;
+  for (addr= 0;  addr < 0x100;  ++addr)
+    if (h->reads[addr] || h->writes[addr])
+      {
+	++zpUsed;
+	zpHigh= addr;
+      }
+  for (addr= 0x1FF;  addr >= 0x100;  --addr)
+    if (h->writes[addr])
+      stackLow= addr;
+
+  if (!strcmp(heatmap.path, "-"))
+    {
+      out= stdout;
+      fflush(stdout);
+    }
+  else if (!(out= fopen(heatmap.path, "w")))
+    pfail(heatmap.path);
+
+  fprintf(out, "# run6502 memory heatmap: %llu reads, %llu writes, %llu instructions executed\n",
+	  (unsigned long long)reads, (unsigned long long)writes, (unsigned long long)executes);
+  fprintf(out, "#\n# pages (accesses on a log scale from '%c' to '%c')\n#     0123456789ABCDEF\n", levels[1], levels[9]);
+  for (page= 0;  page < 256;  ++page)
+    {
+      int level= !pages[page] ? 0 : span ? 1 + 8 * (heatBits(pages[page]) - 1) / span : 9;
+      if (!(page & 15)) fprintf(out, "#  %Xx ", page >> 4);
+      fputc(levels[level], out);
+      if (15 == (page & 15)) fputs("\n", out);
+    }
+
+  fprintf(out, "#\n# page        reads       writes     executes\n");
+  for (page= 0;  page < 256;  ++page)
+    if (pages[page])
+      {
+	uint64_t r= 0, w= 0, x= 0;
+	for (addr= page << 8;  addr < (page + 1) << 8;  ++addr)
+	  {
+	    r += h->reads[addr];
+	    w += h->writes[addr];
+	    x += h->executes[addr];
+	  }
+	fprintf(out, "  %02X   %12llu %12llu %12llu\n", page,
+		(unsigned long long)r, (unsigned long long)w, (unsigned long long)x);
+      }
+
+  if (!(hot= malloc(0x10000 * sizeof(HeatCount)))) fail("out of memory");
+  for (addr= 0;  addr < 0x10000;  ++addr)
+    if ((hot[n].count= heatTotal(addr)))
+      hot[n++].addr= addr;
+  qsort(hot, n, sizeof(HeatCount), heatOrder);
+  fprintf(out, "#\n# hottest addresses\n# address     reads       writes     executes\n");
+  for (i= 0;  (i < n) && (i < heatmap.top);  ++i)
+    fprintf(out, "  %04X %12llu %12llu %12llu\n", hot[i].addr,
+	    (unsigned long long)h->reads[hot[i].addr], (unsigned long long)h->writes[hot[i].addr],
+	    (unsigned long long)h->executes[hot[i].addr]);
+  free(hot);
+
+  fprintf(out, "#\n");
+  if (zpUsed)
+    fprintf(out, "# zero page: %d bytes used, highest %02X\n", zpUsed, zpHigh);
+  else
+    fprintf(out, "# zero page: not used\n");
+  if (stackLow >= 0)
+    fprintf(out, "# stack: lowest %04X (%d bytes deep)\n", stackLow, 0x200 - stackLow);
+  else
+    fprintf(out, "# stack: not written\n");
+
+  if (out == stdout)
+    fflush(stdout);
+  else
+    fclose(out);
+}
+
+
+static void heatmapStart(M6502 *mpu)
+{
+  if (!(heatmap.counts= calloc(1, sizeof(M6502_Heatmap)))) fail("out of memory");
+  M6502_setHeatmap(mpu, heatmap.counts);
+  heatmap.mpu= mpu;
+  atexit(heatmapWrite);	/* -X and friends exit from inside the emulation */
+}
+
+
+static int doHeatmap(int argc, char **argv, M6502 *mpu)	/* --heatmap file[:n] */
+{
+  char *top;
+  if (argc < 2) usage(1);
+  heatmap.path= argv[1];
+  heatmap.top= 20;
+  if ((top= strrchr(argv[1], ':')))
+    {
+      *top++= '\0';
+      if ((heatmap.top= strtol(top, 0, 10)) <= 0)
+	fail("the number of addresses must be positive");
+    }
+  return 1;
+}
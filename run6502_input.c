@@ -0,0 +1,226 @@
+/* run6502_input.c -- guest input pipeline			-*- C -*- */
+
+/* Input for the guest (-G, -M and the -B OSWORD traps) is read from a
+ * file descriptor (stdin by default) by a separate thread into a
+ * single-producer single-consumer ring buffer, so that the emulation
+ * never blocks in read(2).  The producer owns tail and the consumer
+ * owns head; each publishes its index with a release store and reads
+ * the other's with an acquire load, so the common path takes no locks.
+ * The mutex and condition variable are used only when the consumer
+ * has to sleep on an empty ring (the 'block' policy) and the producer
+ * sees that it is waiting.
+ *
+ * What a read does when the ring is empty is set with -W:
+ *
+ *   block	wait for input (as getchar(3) would)
+ *   empty	return at once, reporting that nothing was available
+ *   irq	as 'empty', and raise IRQ when input arrives
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#define INPUT_RING	4096	/* bytes (a power of two) */
+#define INPUT_POLL	1000	/* cycles between checks for new input (irq policy) */
+#define INPUT_NONE	(-2)	/* inputGet(): ring empty and not blocking */
+
+enum { inputBlock, inputEmpty, inputIRQ };
+
+static struct
+{
+  byte		  ring[INPUT_RING];
+  atomic_size_t	  head;		/* next byte to consume */
+  atomic_size_t	  tail;		/* next byte to fill */
+  atomic_int	  eof;		/* producer saw end of input (or an error) */
+  atomic_int	  waiting;	/* consumer is asleep on ready */
+  pthread_mutex_t lock;
+  pthread_cond_t  ready;
+  pthread_t	  thread;
+  int		  started;
+  int		  fd;
+  int		  policy;
+  int		  signalled;	/* irq policy: IRQ raised since ring was last empty */
+  uint64_t	  poll;		/* irq policy: when inputPoll next runs */
+} input= {
+  .lock=  PTHREAD_MUTEX_INITIALIZER,
+  .ready= PTHREAD_COND_INITIALIZER,
+};
+
+
+static void inputWake(void)
+{
+  if (atomic_load(&input.waiting))
+    {
+      pthread_mutex_lock(&input.lock);
+      pthread_cond_broadcast(&input.ready);
+      pthread_mutex_unlock(&input.lock);
+    }
+}
+
+
+static void *inputThread(void *arg)
+{
+  sigset_t signals;
+
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGPROF);		/* --sample interrupts the emulation, not this */
+  pthread_sigmask(SIG_BLOCK, &signals, 0);
+  for (;;)
+    {
+      size_t  head= atomic_load_explicit(&input.head, memory_order_acquire);
+      size_t  tail= atomic_load_explicit(&input.tail, memory_order_relaxed);
+      size_t  room= INPUT_RING - (tail - head);
+      size_t  size= INPUT_RING - (tail & (INPUT_RING - 1));	/* contiguous */
+      ssize_t count;
+
+      if (!room)	/* guest is not keeping up: nothing to do but wait */
+	{
+	  struct timespec pause= { 0, 1000000 };
+	  nanosleep(&pause, 0);
+	  continue;
+	}
+      if (size > room) size= room;
+      if ((count= read(input.fd, input.ring + (tail & (INPUT_RING - 1)), size)) < 0)
+	{
+	  if (EINTR == errno) continue;
+	  count= 0;
+	}
+      if (!count)
+	{
+	  atomic_store(&input.eof, 1);
+	  inputWake();
+	  return 0;
+	}
+      atomic_store(&input.tail, tail + count);	/* seq_cst: ordered before the load of waiting */
+      inputWake();
+    }
+}
+
+
+static void inputStart(void)
+{
+  if (!input.started && !journal.replay)	/* a replay never reads the input */
+    {
+      input.started= 1;
+      if (pthread_create(&input.thread, 0, inputThread, 0))
+	fail("cannot create input thread");
+      pthread_detach(input.thread);
+    }
+}
+
+
+/* sleep until the ring is not empty or input has ended */
+
+static void inputWait(void)
+{
+  size_t head= atomic_load_explicit(&input.head, memory_order_relaxed);
+
+  if (journal.replay) return;
+  inputStart();
+  fflush(stdout);	/* getchar(3) would have flushed a prompt */
+  pthread_mutex_lock(&input.lock);
+  atomic_store(&input.waiting, 1);
+  while ((head == atomic_load(&input.tail)) && !atomic_load(&input.eof))
+    pthread_cond_wait(&input.ready, &input.lock);
+  atomic_store(&input.waiting, 0);
+  pthread_mutex_unlock(&input.lock);
+}
+
+
+static int inputTake(int block)
+{
+  size_t head= atomic_load_explicit(&input.head, memory_order_relaxed);
+  int	 c;
+
+  inputStart();
+  if (head == atomic_load_explicit(&input.tail, memory_order_acquire))
+    {
+      if (atomic_load(&input.eof) && (head == atomic_load(&input.tail)))
+	return EOF;
+      if (!block)
+	return INPUT_NONE;
+      inputWait();
+      if (head == atomic_load(&input.tail))
+	return EOF;
+    }
+  c= input.ring[head & (INPUT_RING - 1)];
+  atomic_store_explicit(&input.head, head + 1, memory_order_release);
+  return c;
+}
+
+
+/* answers the next byte of input, EOF at the end of input, or
+ * INPUT_NONE if the ring is empty and block is zero.
+ */
+
+static int inputGet(int block)
+{
+  if (journal.replay)
+    return (int)journalNext(JOURNAL_GET) - 2;
+  return (int)journalLog(JOURNAL_GET, inputTake(block) + 2) - 2;
+}
+
+
+/* answers non-zero if a byte is waiting (or input has ended) */
+
+static int inputReady(void)
+{
+  if (journal.replay)
+    return journalNext(JOURNAL_READY);
+  inputStart();
+  return journalLog(JOURNAL_READY, (atomic_load_explicit(&input.head, memory_order_relaxed) != atomic_load_explicit(&input.tail, memory_order_acquire))
+		    || atomic_load(&input.eof));
+}
+
+
+/* irq policy: raise IRQ once each time the ring becomes non-empty */
+
+static void inputPoll(M6502 *mpu, uint64_t when, void *data)
+{
+  if (journal.replay)
+    {
+      if (journalIRQ())
+	M6502_scheduleIRQ(mpu, when);
+    }
+  else if (atomic_load_explicit(&input.head, memory_order_relaxed) == atomic_load_explicit(&input.tail, memory_order_acquire))
+    input.signalled= 0;
+  else if (!input.signalled)
+    {
+      input.signalled= 1;
+      journalLog(JOURNAL_IRQ, 0);
+      M6502_scheduleIRQ(mpu, when);
+    }
+  M6502_schedule(mpu, input.poll= when + INPUT_POLL, inputPoll, 0);
+}
+
+
+static int doInput(int argc, char **argv, M6502 *mpu)	/* -F file */
+{
+  char *end;
+  long	fd;
+  if (argc < 2) usage(1);
+  fd= strtol(argv[1], &end, 10);
+  if (*end || end == argv[1])
+    {
+      if ((fd= open(argv[1], O_RDONLY)) < 0)
+	pfail(argv[1]);
+    }
+  input.fd= fd;
+  return 1;
+}
+
+
+static int doWait(int argc, char **argv, M6502 *mpu)	/* -W policy */
+{
+  if (argc < 2) usage(1);
+  if      (!strcmp(argv[1], "block"))	input.policy= inputBlock;
+  else if (!strcmp(argv[1], "empty"))	input.policy= inputEmpty;
+  else if (!strcmp(argv[1], "irq"))	input.policy= inputIRQ;
+  else fail("unknown input policy: %s", argv[1]);
+  return 1;
+}
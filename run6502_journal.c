@@ -0,0 +1,233 @@
+/* run6502_journal.c -- record and replay of guest input (-j, -J)	-*- C -*- */
+
+/* Everything the guest learns from outside the emulator arrives through
+ * a few doors: the bytes and status returned by the input pipeline
+ * (-G, -M and the -B line input), values returned by read callbacks
+ * (the -M traps and plugin devices), and the IRQ raised when input
+ * arrives (-W irq).  With -j file each of these is written to a journal
+ * together with the clock cycle at which the guest saw it.  With -J
+ * file the journal is read back instead: the same values are delivered
+ * at the same cycles, the real input is never read and the read
+ * callbacks are never called, so the run is repeated exactly however
+ * the input was timed the first time.  A replay that asks for something
+ * the journal does not hold (because the program, the options or a
+ * device behaves differently) stops with a message saying where.
+ *
+ * The journal starts with JOURNAL_MAGIC; each record is then a kind
+ * byte followed by the cycles since the previous record and a value,
+ * both as unsigned LEB128 numbers.  Values are
+ *
+ *	JOURNAL_READ	address << 8 | byte
+ *	JOURNAL_GET	the result of inputGet() + 2 (EOF and INPUT_NONE are negative)
+ *	JOURNAL_READY	the result of inputReady()
+ *	JOURNAL_IRQ	0
+ *
+ * A JOURNAL_REPEAT byte followed by a count n (as LEB128) stands for n
+ * more copies of the previous record, each the same number of cycles
+ * after the one before it (a guest polling a status register makes
+ * long runs of them).
+ *
+ * Write and call callbacks (plugin devices included) are assumed to be
+ * deterministic.
+ */
+
+#define JOURNAL_MAGIC	"run6502-journal 1\n"
+
+enum { JOURNAL_READ= 1, JOURNAL_GET, JOURNAL_READY, JOURNAL_IRQ, JOURNAL_REPEAT };
+
+static const char *journalKinds[]= { "end of journal", "read", "input", "input status", "input IRQ" };
+
+static struct
+{
+  const char	 *path;		/* -j or -J argument, or 0 */
+  int		  replay;	/* -J */
+  FILE		 *file;
+  M6502		 *mpu;
+  uint64_t	  cycles;	/* of the last record */
+  int		  depth;	/* inside a read callback: input is not journalled separately */
+  M6502_Callback  read[0x10000];
+  struct { int kind;  uint64_t delta;  unsigned value;  uint64_t repeats; } last;	/* record */
+  struct { int kind;  uint64_t cycles, delta;  unsigned value;  uint64_t repeats; } next;	/* replay */
+} journal;
+
+
+static void journalPut(uint64_t n)
+{
+  do
+    {
+      byte b= n & 0x7F;
+      if ((n >>= 7)) b |= 0x80;
+      putc(b, journal.file);
+    }
+  while (n);
+}
+
+
+static int journalGetNumber(uint64_t *n)
+{
+  int c, shift= 0;
+  *n= 0;
+  do
+    {
+      if (EOF == (c= getc(journal.file)) || (shift > 63)) return 0;
+      *n |= (uint64_t)(c & 0x7F) << shift;
+      shift += 7;
+    }
+  while (c & 0x80);
+  return 1;
+}
+
+
+static void journalAdvance(void)
+{
+  uint64_t delta, value;
+  int	   kind;
+
+  if (!journal.next.repeats)
+    {
+      kind= getc(journal.file);
+      if ((JOURNAL_REPEAT == kind) && journalGetNumber(&journal.next.repeats) && journal.next.repeats)
+	kind= journal.next.kind;
+      else if ((kind < JOURNAL_READ) || (kind > JOURNAL_IRQ) || !journalGetNumber(&delta) || !journalGetNumber(&value))
+	{
+	  journal.next.kind= 0;
+	  return;
+	}
+      else
+	{
+	  journal.next.kind= kind;
+	  journal.next.cycles += delta;
+	  journal.next.delta= delta;
+	  journal.next.value= value;
+	  return;
+	}
+    }
+  --journal.next.repeats;
+  journal.next.cycles += journal.next.delta;
+}
+
+
+static void journalFlush(void)
+{
+  if (journal.last.repeats)
+    {
+      putc(JOURNAL_REPEAT, journal.file);
+      journalPut(journal.last.repeats);
+      journal.last.repeats= 0;
+    }
+}
+
+
+static void journalEnd(void)
+{
+  journalFlush();
+  fclose(journal.file);
+}
+
+
+/* recording: write value as a record of the given kind, and return it */
+
+static unsigned journalLog(int kind, unsigned value)
+{
+  if (journal.file && !journal.replay && !journal.depth)
+    {
+      uint64_t delta= journal.mpu->cycles - journal.cycles;
+      if ((kind == journal.last.kind) && (delta == journal.last.delta) && (value == journal.last.value))
+	++journal.last.repeats;
+      else
+	{
+	  journalFlush();
+	  putc(kind, journal.file);
+	  journalPut(delta);
+	  journalPut(value);
+	  journal.last.kind=  kind;
+	  journal.last.delta= delta;
+	  journal.last.value= value;
+	}
+      journal.cycles= journal.mpu->cycles;
+    }
+  return value;
+}
+
+
+/* replaying: answer the value of the next record, which must be of
+ * the given kind and have been made at the current cycle
+ */
+
+static unsigned journalNext(int kind)
+{
+  unsigned value= journal.next.value;
+  if ((kind != journal.next.kind) || (journal.mpu->cycles != journal.next.cycles))
+    fail("%s: replay diverged at cycle %llu: %s wanted, journal has %s at cycle %llu",
+	 journal.path, (unsigned long long)journal.mpu->cycles, journalKinds[kind],
+	 journalKinds[journal.next.kind], (unsigned long long)journal.next.cycles);
+  journalAdvance();
+  return value;
+}
+
+
+/* replaying: answer non-zero if an input IRQ is due now */
+
+static int journalIRQ(void)
+{
+  if ((JOURNAL_IRQ != journal.next.kind) || (journal.mpu->cycles != journal.next.cycles))
+    return 0;
+  journalAdvance();
+  return 1;
+}
+
+
+static int journalRead(M6502 *mpu, word addr, byte data)
+{
+  int value;
+  if (journal.replay)
+    {
+      unsigned v= journalNext(JOURNAL_READ);
+      if ((v >> 8) != addr)
+	fail("%s: replay diverged at cycle %llu: read from %04X, journal has %04X",
+	     journal.path, (unsigned long long)mpu->cycles, addr, v >> 8);
+      return v & 0xFF;
+    }
+  ++journal.depth;
+  value= journal.read[addr](mpu, addr, data);
+  --journal.depth;
+  journalLog(JOURNAL_READ, (addr << 8) | (byte)value);
+  return value;
+}
+
+
+/* called when the machine is set up and about to run */
+
+static void journalStart(M6502 *mpu)
+{
+  char	   magic[sizeof(JOURNAL_MAGIC)];
+  unsigned addr;
+
+  if (!journal.path) return;
+  journal.mpu= mpu;
+  journal.cycles= journal.next.cycles= mpu->cycles;
+  if (!(journal.file= fopen(journal.path, journal.replay ? "rb" : "wb"))) pfail(journal.path);
+  if (journal.replay)
+    {
+      if (!fgets(magic, sizeof(magic), journal.file) || strcmp(magic, JOURNAL_MAGIC))
+	fail("%s: not a run6502 journal", journal.path);
+      journalAdvance();
+    }
+  else
+    {
+      fputs(JOURNAL_MAGIC, journal.file);
+      atexit(journalEnd);	/* -X and friends exit from inside the emulation */
+    }
+  for (addr= 0;  addr < 0x10000;  ++addr)
+    if ((journal.read[addr]= M6502_getCallback(mpu, read, addr)))
+      M6502_setCallback(mpu, read, addr, journalRead);
+}
+
+
+static int doJournal(int argc, char **argv, M6502 *mpu)	/* -j file, -J file */
+{
+  if (argc < 2) usage(1);
+  journal.path= argv[1];
+  journal.replay= ('J' == argv[0][1]);
+  return 1;
+}
@@ -0,0 +1,61 @@
+/* run6502_plugin.h -- interface between run6502 and device plugins	-*- C -*- */
+
+/* A device plugin is a shared object loaded by 'run6502 -D file[:args]'.
+ * It must define
+ *
+ *	int run6502_plugin_init(Run6502_Host *host, const char *args);
+ *
+ * which is called once, while the command line is being processed, with
+ * the (possibly empty) string that followed the ':' in the -D argument.
+ * It answers non-zero on success.  The plugin claims the addresses it
+ * decodes with host->map() and the subroutine entry points it emulates
+ * with host->trap(); every address not claimed by some device keeps the
+ * fast path (plain memory) in the emulator.  Time-driven behaviour is
+ * implemented with host->schedule() rather than by polling.
+ */
+
+#ifndef __run6502_plugin_h
+#define __run6502_plugin_h
+
+#include "lib6502.h"
+
+#define RUN6502_PLUGIN_VERSION	1
+
+typedef struct _Run6502_Host Run6502_Host;
+
+struct _Run6502_Host
+{
+  int	  version;	/* RUN6502_PLUGIN_VERSION */
+  M6502	 *mpu;
+  const char *name;	/* of the plugin being initialised */
+
+  /* claim first..last (inclusive) for read and/or write callbacks
+   * (either may be NULL); fails if another device already claimed any
+   * of them */
+  void	(*map)(Run6502_Host *host, uint16_t first, uint16_t last, M6502_Callback read, M6502_Callback write);
+
+  /* claim a JSR/JMP (or BRK, at the IRQ handler) trap at addr */
+  void	(*trap)(Run6502_Host *host, uint16_t addr, M6502_Callback call);
+
+  /* the lib6502 scheduler and interrupt entry points */
+  void	(*schedule)(M6502 *mpu, uint64_t when, M6502_Event event, void *data);
+  int	(*cancel)(M6502 *mpu, M6502_Event event, void *data);
+  void	(*scheduleIRQ)(M6502 *mpu, uint64_t when);
+  void	(*scheduleNMI)(M6502 *mpu, uint64_t when);
+
+  /* print a message on stderr and exit */
+  void	(*fail)(const char *fmt, ...);
+};
+
+typedef int (*Run6502_PluginInit)(Run6502_Host *host, const char *args);
+
+#define RUN6502_PLUGIN_INIT	"run6502_plugin_init"
+
+/* return from a subroutine trap (as if the trap had executed RTS) */
+
+#define Run6502_rts(MPU)								\
+  ( (MPU)->registers->s += 2,								\
+    (uint16_t)(((MPU)->memory[0x100 + (uint8_t)((MPU)->registers->s - 1)]		\
+		| ((MPU)->memory[0x100 + (MPU)->registers->s] << 8)) + 1) )
+
+#endif /* __run6502_plugin_h */
@@ -0,0 +1,93 @@
+/* run6502_profile.c -- opcode sequence profile (-O)		-*- C -*- */
+
+/* With -O the program is executed one instruction at a time and every
+ * pair and triple of consecutively executed opcodes is counted.  When
+ * the emulation ends (for whatever reason) the counts are written to
+ * the file, most frequent first, one sequence per line:
+ *
+ *	count op op [op]
+ *
+ * with the opcodes in hex.  bench/fuse.pl reads these profiles to
+ * choose the superinstructions compiled into lib6502 (see
+ * lib6502_fused.h).
+ */
+
+static struct
+{
+  const char	*path;
+  uint64_t	 insns;
+  uint64_t	*pairs;		/* [op1 << 8 | op2] */
+  uint32_t	*triples;	/* [op1 << 16 | op2 << 8 | op3] */
+} profile;
+
+typedef struct
+{
+  uint64_t	count;
+  unsigned	ops;
+  int		length;
+} Sequence;
+
+
+static int profileOrder(const void *a, const void *b)
+{
+  const Sequence *p= a, *q= b;
+  if (p->count != q->count) return (p->count < q->count) ? 1 : -1;
+  if (p->length != q->length) return p->length - q->length;
+  return (p->ops > q->ops) - (p->ops < q->ops);
+}
+
+
+static void profileWrite(void)
+{
+  Sequence *seqs;
+  size_t    n= 0, i;
+  FILE	   *out;
+
+  for (i= 0;  i < 0x10000;    ++i) n += !!profile.pairs[i];
+  for (i= 0;  i < 0x1000000;  ++i) n += !!profile.triples[i];
+  if (!(seqs= calloc(n + 1, sizeof(Sequence)))) fail("out of memory");
+  n= 0;
+  for (i= 0;  i < 0x10000;    ++i) if (profile.pairs[i])   seqs[n++]= (Sequence){ profile.pairs[i],   i, 2 };
+  for (i= 0;  i < 0x1000000;  ++i) if (profile.triples[i]) seqs[n++]= (Sequence){ profile.triples[i], i, 3 };
+  qsort(seqs, n, sizeof(Sequence), profileOrder);
+
+  if (!(out= fopen(profile.path, "w"))) pfail(profile.path);
+  fprintf(out, "# run6502 opcode sequence profile: %llu instructions\n", (unsigned long long)profile.insns);
+  for (i= 0;  i < n;  ++i)
+    if (2 == seqs[i].length)
+      fprintf(out, "%llu %02x %02x\n", (unsigned long long)seqs[i].count, seqs[i].ops >> 8, seqs[i].ops & 0xff);
+    else
+      fprintf(out, "%llu %02x %02x %02x\n", (unsigned long long)seqs[i].count, seqs[i].ops >> 16, (seqs[i].ops >> 8) & 0xff, seqs[i].ops & 0xff);
+  fclose(out);
+  free(seqs);
+}
+
+
+static void profileRun(M6502 *mpu)
+{
+  unsigned history= 0;	/* the last two opcodes, and how many there are (in bits 16-17) */
+
+  if (!(profile.pairs=   calloc(0x10000,   sizeof(uint64_t))) ||
+      !(profile.triples= calloc(0x1000000, sizeof(uint32_t))))
+    fail("out of memory");
+  atexit(profileWrite);	/* -X and friends exit from inside the emulation */
+  for (;;)
+    {
+      unsigned op= mpu->memory[mpu->registers->pc];
+      ++profile.insns;
+      if (history >= 0x10000) ++profile.pairs[((history & 0xff) << 8) | op];
+      if (history >= 0x20000) ++profile.triples[((history & 0xffff) << 8) | op];
+      history= ((history >= 0x10000 ? 0x20000 : 0x10000)) | ((history & 0xff) << 8) | op;
+      if (!M6502_step(mpu) || M6502_stopped(mpu, 0))
+	break;
+    }
+  reportStop(mpu);
+}
+
+
+static int doProfile(int argc, char **argv, M6502 *mpu)	/* -O file */
+{
+  if (argc < 2) usage(1);
+  profile.path= argv[1];
+  return 1;
+}
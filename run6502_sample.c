@@ -0,0 +1,183 @@
+/* run6502_sample.c -- statistical profile (--sample)		-*- C -*- */
+
+/* With --sample file[:period] a SIGPROF timer interrupts the emulation
+ * every period microseconds of CPU time (1000 by default).  The signal
+ * handler only calls M6502_signal(); at the next instruction boundary
+ * the library calls sampleTake() with the registers up to date, and it
+ * records the PC and the guest's call stack.  The emulation itself runs
+ * in the normal engine, so the cost is that of the samples alone.
+ *
+ * The call stack is reconstructed from page 1: every pair of bytes
+ * between S and the top of the stack that holds the address of the
+ * last byte of a JSR instruction is taken to be a return address, and
+ * the operand of that JSR to be the subroutine called.  (Data that
+ * happens to look like a return address is counted too.)
+ *
+ * When the emulation ends the report is written to the file ('-' for
+ * stdout): the instructions at which samples were taken, and the
+ * subroutines that were active (with everything they called), most
+ * frequent first.  Runs with --sample are not cached.
+ */
+
+#include <signal.h>
+#include <sys/time.h>
+
+#define SAMPLE_DEPTH	64		/* frames examined per sample */
+
+static struct
+{
+  const char	*path;
+  long		 period;	/* microseconds */
+  M6502		*mpu;		/* until the report is written */
+  uint64_t	 samples;
+  uint32_t	*self;		/* [pc] */
+  uint32_t	*total;		/* [subroutine] */
+} sample;
+
+typedef struct
+{
+  uint32_t	count;
+  word		addr;
+} SampleCount;
+
+
+static void sampleSignal(int signum)
+{
+  if (sample.mpu) M6502_signal(sample.mpu);
+}
+
+
+static void sampleTake(M6502 *mpu, uint64_t when, void *data)
+{
+  byte *m= mpu->memory;
+  word  callees[SAMPLE_DEPTH];
+  int	ncallees= 0, i, j;
+
+  ++sample.samples;
+  ++sample.self[mpu->registers->pc];
+  for (i= mpu->registers->s + 1;  (i < 0xFF) && (ncallees < SAMPLE_DEPTH);  ++i)
+    {
+      word ret= m[0x100 + i] | (m[0x100 + i + 1] << 8);
+      word callee;
+      if (0x20 != m[(word)(ret - 2)])
+	continue;
+      callee= m[(word)(ret - 1)] | (m[ret] << 8);
+      for (j= 0;  (j < ncallees) && (callees[j] != callee);  ++j)
+	;
+      if (j == ncallees)
+	{
+	  callees[ncallees++]= callee;
+	  ++sample.total[callee];
+	}
+      ++i;
+    }
+}
+
+
+static int sampleOrder(const void *a, const void *b)
+{
+  const SampleCount *p= a, *q= b;
+  if (p->count != q->count) return (p->count < q->count) ? 1 : -1;
+  return p->addr - q->addr;
+}
+
+
+static int sampleSort(uint32_t *counts, SampleCount *sorted)
+{
+  int n= 0, addr;
+  for (addr= 0;  addr < 0x10000;  ++addr)
+    if (counts[addr])
+      {
+	sorted[n].count= counts[addr];
+	sorted[n++].addr= addr;
+      }
+  qsort(sorted, n, sizeof(SampleCount), sampleOrder);
+  return n;
+}
+
+
+static void sampleWrite(void)
+{
+  static const struct itimerval stop;
+  SampleCount *sorted;
+  FILE	      *out;
+  M6502	      *mpu= sample.mpu;
+  double       all= sample.samples ? sample.samples : 1;
+  int	       n, i;
+
+  if (!mpu)
+    return;
+  setitimer(ITIMER_PROF, &stop, 0);
+  sample.mpu= 0;
+  if (!(sorted= malloc(0x10000 * sizeof(SampleCount)))) fail("out of memory");
+  if (!strcmp(sample.path, "-"))
+    {
+      out= stdout;
+      fflush(stdout);
+    }
+  else if (!(out= fopen(sample.path, "w")))
+    pfail(sample.path);
+
+  fprintf(out, "# run6502 sample profile: %llu samples, one every %ld microseconds\n",
+	  (unsigned long long)sample.samples, sample.period);
+  fprintf(out, "#\n# instructions\n#  samples      %%  address  instruction\n");
+  n= sampleSort(sample.self, sorted);
+  for (i= 0;  i < n;  ++i)
+    {
+      char insn[64];
+      M6502_disassemble(mpu, sorted[i].addr, insn);
+      fprintf(out, "%9lu %5.1f%%  %04X     %s\n",
+	      (unsigned long)sorted[i].count, 100.0 * sorted[i].count / all, sorted[i].addr, insn);
+    }
+  fprintf(out, "#\n# subroutines (including everything they called)\n#  samples      %%  address\n");
+  n= sampleSort(sample.total, sorted);
+  for (i= 0;  i < n;  ++i)
+    fprintf(out, "%9lu %5.1f%%  %04X\n",
+	    (unsigned long)sorted[i].count, 100.0 * sorted[i].count / all, sorted[i].addr);
+
+  if (out == stdout)
+    fflush(stdout);
+  else
+    fclose(out);
+  free(sorted);
+}
+
+
+static void sampleStart(M6502 *mpu)
+{
+  struct sigaction  action;
+  struct itimerval  timer;
+
+  if (!(sample.self=  calloc(0x10000, sizeof(uint32_t))) ||
+      !(sample.total= calloc(0x10000, sizeof(uint32_t))))
+    fail("out of memory");
+  sample.mpu= mpu;
+  M6502_setSignal(mpu, sampleTake, 0);
+  atexit(sampleWrite);	/* -X and friends exit from inside the emulation */
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler= sampleSignal;
+  action.sa_flags= SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SIGPROF, &action, 0)) pfail("sigaction");
+  timer.it_interval.tv_sec=  sample.period / 1000000;
+  timer.it_interval.tv_usec= sample.period % 1000000;
+  timer.it_value= timer.it_interval;
+  if (setitimer(ITIMER_PROF, &timer, 0)) pfail("setitimer");
+}
+
+
+static int doSample(int argc, char **argv, M6502 *mpu)	/* --sample file[:period] */
+{
+  char *period;
+  if (argc < 2) usage(1);
+  sample.path= argv[1];
+  sample.period= 1000;
+  if ((period= strrchr(argv[1], ':')))
+    {
+      *period++= '\0';
+      if ((sample.period= strtol(period, 0, 10)) <= 0)
+	fail("sample period must be a positive number of microseconds");
+    }
+  return 1;
+}
@@ -0,0 +1,73 @@
+/* run6502_stats.c -- performance counters (--stats)		-*- C -*- */
+
+/* With --stats file the processor counts what it does (see
+ * M6502_setCounting) and when the emulation ends, for whatever reason,
+ * the counters are written to the file ('-' for stdout) as a JSON
+ * object:
+ *
+ *	{ "instructions": 1234, "cycles": 4321,
+ *	  "callbacks": { "read": 0, "write": 0, "call": 27, "nanoseconds": 51234 },
+ *	  "interrupts": { "irq": 0, "nmi": 0 },
+ *	  "opcodes": { "20": 27, "8a": 26, ... } }
+ *
+ * "opcodes" has the opcodes (in hex) that were executed at least once.
+ * Counting makes the emulation slower, and results are not cached.
+ */
+
+static struct
+{
+  const char	*path;
+  M6502		*mpu;		/* until it is written */
+} stats;
+
+
+static void statsWrite(void)
+{
+  M6502_Counters  c;
+  FILE		 *out;
+  int		  i, n= 0;
+
+  if (!stats.mpu)
+    return;
+  M6502_getCounters(stats.mpu, &c);
+  stats.mpu= 0;
+  if (!strcmp(stats.path, "-"))
+    {
+      out= stdout;
+      fflush(stdout);
+    }
+  else if (!(out= fopen(stats.path, "w")))
+    pfail(stats.path);
+  fprintf(out, "{ \"instructions\": %llu, \"cycles\": %llu,\n",
+	  (unsigned long long)c.instructions, (unsigned long long)c.cycles);
+  fprintf(out, "  \"callbacks\": { \"read\": %llu, \"write\": %llu, \"call\": %llu, \"nanoseconds\": %llu },\n",
+	  (unsigned long long)c.reads, (unsigned long long)c.writes, (unsigned long long)c.calls,
+	  (unsigned long long)c.callbackTime);
+  fprintf(out, "  \"interrupts\": { \"irq\": %llu, \"nmi\": %llu },\n",
+	  (unsigned long long)c.irqs, (unsigned long long)c.nmis);
+  fprintf(out, "  \"opcodes\": {");
+  for (i= 0;  i < 256;  ++i)
+    if (c.opcodes[i])
+      fprintf(out, "%s\n    \"%02x\": %llu", n++ ? "," : "", i, (unsigned long long)c.opcodes[i]);
+  fprintf(out, "%s} }\n", n ? "\n  " : " ");
+  if (out == stdout)
+    fflush(stdout);
+  else
+    fclose(out);
+}
+
+
+static void statsStart(M6502 *mpu)
+{
+  M6502_setCounting(mpu, 1);
+  stats.mpu= mpu;
+  atexit(statsWrite);	/* -X and friends exit from inside the emulation */
+}
+
+
+static int doStats(int argc, char **argv, M6502 *mpu)	/* --stats file */
+{
+  if (argc < 2) usage(1);
+  stats.path= argv[1];
+  return 1;
+}